@@ -0,0 +1,568 @@
+/*
+Bus class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstring>
+// Include local header files
+#include "Bus.h"
+#include "MBC.h"
+#include "PPU.h"
+
+// Create Bus object
+Bus::Bus() {
+  memory_size = base_memory_size;
+  memory = new uint8_t[memory_size];
+  memset(memory, 0, memory_size);
+#ifdef GREGGB_DIRTY_PAGES
+  markAllDirty();
+#endif
+  memset(boot_rom, 0, sizeof(boot_rom));
+  mbc = nullptr;
+  ppu = nullptr;
+  switched_regions = 0;
+  polled_io = false;
+  boot_rom_mapped = true;
+  low_rom = nullptr;
+  memset(watched, 0, sizeof(watched));
+  watching_exec = false;
+  watch_handler = nullptr;
+  watch_context = nullptr;
+  //  I/O, HRAM, and IE handlers for each address (if any), filled in first as
+  // mapping page 0xff copies them. Reads of I/O registers other than IF, STAT,
+  // and LY (which only change at PPU events or when the CPU writes them) are
+  // noted, so the CPU doesn't skip loops polling them (see takePolledIO)
+  for (int index = 0; index < 256; index++) {
+    mapped_high_read[index] = nullptr;
+    mapped_high_write[index] = nullptr;
+    if (index < 0x80 && index != 0x0f && index != 0x41 && index != 0x44) {
+      mapped_high_read[index] = &Bus::readPolled;
+    } else if (index < 0x80 && io_read_mask[index] != 0) {
+      mapped_high_read[index] = &Bus::readMasked;
+    }
+    if (index < 0x80 && io_read_mask[index] == 0xff) {
+      mapped_high_write[index] = &Bus::writeIgnored; // Nothing there
+    }
+  }
+  mapped_high_read[0x00] = &Bus::readJoypad;
+  mapped_high_write[0x00] = &Bus::writeJoypad;
+  mapped_high_write[0x04] = &Bus::writeDIV;
+  mapped_high_write[0x26] = &Bus::writeNR52;
+  mapped_high_write[0x40] = &Bus::writeLCDC;
+  mapped_high_write[0x41] = &Bus::writeSTAT;
+  mapped_high_write[0x42] = &Bus::writeLCDRegister; // SCY
+  mapped_high_write[0x43] = &Bus::writeLCDRegister; // SCX
+  mapped_high_write[0x44] = &Bus::writeIgnored; // LY is read only
+  mapped_high_write[0x45] = &Bus::writeLYC;
+  mapped_high_write[0x46] = &Bus::writeDMA;
+  mapped_high_write[0x47] = &Bus::writeLCDRegister; // BGP
+  mapped_high_write[0x48] = &Bus::writeLCDRegister; // OBP0
+  mapped_high_write[0x49] = &Bus::writeLCDRegister; // OBP1
+  mapped_high_write[0x4a] = &Bus::writeLCDRegister; // WY
+  mapped_high_write[0x4b] = &Bus::writeLCDRegister; // WX
+  mapped_high_write[0x50] = &Bus::writeBoot;
+  // Every page starts out with nothing on it
+  for (int page = 0; page < 256; page++) {
+    mapped[page].read = mapped[page].write = nullptr;
+  }
+  setHandlers(0x00, 0xff, &Bus::readOpenBus, &Bus::writeIgnored);
+  // ROM (0x0000-0x7fff), open bus until mapROM, writes go to the MBC
+  setHandlers(0x00, 0x7f, &Bus::readOpenBus, &Bus::writeMBC);
+  mapReadOnly(0x00, 0x00, boot_rom);
+  // VRAM (0x8000-0x9fff)
+  mapVRAM();
+  // External RAM (0xa000-0xbfff), none until mapROM
+  setHandlers(0xa0, 0xbf, &Bus::readOpenBus, &Bus::writeIgnored);
+  // WRAM (0xc000-0xdfff), and echo RAM (0xe000-0xfdff) is WRAM again
+  mapPages(0xc0, 0xdf, memory + memoryOffset(0xc000));
+  mapPages(0xe0, 0xfd, memory + memoryOffset(0xc000));
+  // OAM and the unusable area (0xfe00-0xfeff)
+  setHandlers(0xfe, 0xfe, &Bus::readOAM, &Bus::writeOAM);
+  // I/O, HRAM, and IE (0xff00-0xffff), each address has its own handler (if any)
+  setHandlers(0xff, 0xff, &Bus::readHighPage, &Bus::writeHighPage);
+}
+
+void Bus::mapVRAM() {
+  //  Tile data (0x8000-0x97ff) reads straight from memory but writes through
+  // writeVRAM, the tile maps (0x9800-0x9fff) are plain memory
+  mapReadOnly(0x80, 0x97, memory + memoryOffset(0x8000));
+  setHandlers(0x80, 0x97, &Bus::readOpenBus, &Bus::writeVRAM);
+  mapPages(0x98, 0x9f, memory + memoryOffset(0x9800));
+}
+
+void Bus::mapPages(uint8_t first, uint8_t last, uint8_t *host) {
+  for (int page = first; page <= last; page++) {
+    mapped[page].read = host + (page - first) * 256;
+    mapped[page].write = host + (page - first) * 256;
+    updatePage(page);
+  }
+}
+
+void Bus::mapReadOnly(uint8_t first, uint8_t last, const uint8_t *host) {
+  // Writes to read only pages go to the page's write handler
+  for (int page = first; page <= last; page++) {
+    mapped[page].read = host + (page - first) * 256;
+    mapped[page].write = nullptr;
+    updatePage(page);
+  }
+}
+
+void Bus::setHandlers(uint8_t first, uint8_t last, ReadHandler read, WriteHandler write) {
+  for (int page = first; page <= last; page++) {
+    mapped[page].read_handler = read;
+    mapped[page].write_handler = write;
+    updatePage(page);
+  }
+}
+
+void Bus::updatePage(uint8_t page) {
+  //  Copy the page's mapping to the tables the bus reads, sending reads and
+  // writes to the watch handlers if they are watched. Page 0xff always uses its
+  // handlers, its addresses are watched in the per-address tables instead
+  const Mapping &mapping = mapped[page];
+  bool read = page != 0xff && (watched[page] & WATCH_READ);
+  bool write = page != 0xff && (watched[page] & WATCH_WRITE);
+  read_page[page] = read ? nullptr : mapping.read;
+  write_page[page] = write ? nullptr : mapping.write;
+  read_handler[page] = read ? &Bus::readWatched : mapping.read_handler;
+  write_handler[page] = write ? &Bus::writeWatched : mapping.write_handler;
+  if (page == 0xff) {
+    for (int index = 0; index < 256; index++) {
+      uint8_t kinds = watched[0xff] != 0 ? watchedKinds(0xff00 + index) : 0;
+      high_read[index] = kinds & WATCH_READ ? &Bus::readWatched : mapped_high_read[index];
+      high_write[index] = kinds & WATCH_WRITE ? &Bus::writeWatched : mapped_high_write[index];
+    }
+  }
+}
+
+// Slow path handlers
+uint8_t Bus::readOpenBus(Bus &, uint16_t) {
+  // Nothing is driving the data bus
+  return 0xff;
+}
+
+void Bus::writeIgnored(Bus &, uint16_t, uint8_t) {}
+
+void Bus::writeMBC(Bus &bus, uint16_t addr, uint8_t val) {
+  // MBC registers, ROM itself is read only
+  if (bus.mbc != nullptr) {
+    bus.mbc->write(addr, val);
+  }
+}
+
+void Bus::writeVRAM(Bus &bus, uint16_t addr, uint8_t val) {
+  // Tile data, the PPU's decoded copy of the tile is out of date if it changed
+  uint8_t &byte = bus.memory[memoryOffset(addr)];
+  if (byte != val) {
+    byte = val;
+    bus.markDirty(&byte);
+    if (bus.ppu != nullptr) {
+      bus.ppu->tileWritten((addr - 0x8000) >> 4);
+    }
+  }
+}
+
+uint8_t Bus::readOAM(Bus &bus, uint16_t addr) {
+  // The unusable area after OAM (0xfea0-0xfeff) reads as 0
+  if (addr >= 0xfea0) {
+    return 0;
+  }
+  return bus.memory[memoryOffset(addr)];
+}
+
+void Bus::writeOAM(Bus &bus, uint16_t addr, uint8_t val) {
+  // Writes to the unusable area are ignored
+  if (addr < 0xfea0) {
+    bus.memory[memoryOffset(addr)] = val;
+    bus.markDirty(bus.memory + memoryOffset(addr));
+  }
+}
+
+uint8_t Bus::readHighPage(Bus &bus, uint16_t addr) {
+  return bus.readHigh(addr & 0xff);
+}
+
+void Bus::writeHighPage(Bus &bus, uint16_t addr, uint8_t val) {
+  bus.writeHigh(addr & 0xff, val);
+}
+
+// I/O register handlers
+//  Bits of each I/O register (0xff00-0xff7f) that always read as 1 on DMG,
+// unused registers read as 0xff
+const uint8_t Bus::io_read_mask[0x80] = {
+  0x00, 0x00, 0x7e, 0xff, 0x00, 0x00, 0x00, 0xf8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe0, // 0xff00 (joypad, serial, timer, IF)
+  0x80, 0x3f, 0x00, 0xff, 0xbf, 0xff, 0x3f, 0x00, 0xff, 0xbf, 0x7f, 0xff, 0x9f, 0xff, 0xbf, 0xff, // 0xff10 (audio)
+  0xff, 0x00, 0x00, 0xbf, 0x00, 0x00, 0x70, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // 0xff20 (audio)
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xff30 (wave RAM)
+  0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, // 0xff40 (LCD)
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // 0xff50 (boot ROM off)
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // 0xff60
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff  // 0xff70
+};
+
+uint8_t Bus::readMasked(Bus &bus, uint16_t addr) {
+  return bus.memory[memoryOffset(addr)] | io_read_mask[addr & 0x7f];
+}
+
+uint8_t Bus::readPolled(Bus &bus, uint16_t addr) {
+  bus.polled_io = true;
+  return bus.memory[memoryOffset(addr)] | io_read_mask[addr & 0x7f];
+}
+
+uint8_t Bus::readJoypad(Bus &bus, uint16_t addr) {
+  // Only the select bits (4-5) are stored, no buttons are pressed yet (all 1s)
+  bus.polled_io = true;
+  return 0xc0 | (bus.memory[memoryOffset(addr)] & 0x30) | 0x0f;
+}
+
+void Bus::writeJoypad(Bus &bus, uint16_t addr, uint8_t val) {
+  bus.memory[memoryOffset(addr)] = val & 0x30;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeDIV(Bus &bus, uint16_t addr, uint8_t) {
+  // Any write resets the divider
+  bus.memory[memoryOffset(addr)] = 0;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeNR52(Bus &bus, uint16_t addr, uint8_t val) {
+  // Only the power bit can be written, the channel on bits are read only
+  bus.memory[memoryOffset(addr)] = val & 0x80;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeLCDC(Bus &bus, uint16_t addr, uint8_t val) {
+  // The PPU turns the LCD on or off
+  if (bus.ppu != nullptr) {
+    bus.ppu->writeLCDC(val);
+    return;
+  }
+  bus.memory[memoryOffset(addr)] = val;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeSTAT(Bus &bus, uint16_t addr, uint8_t val) {
+  // The mode and LY=LYC bits (0-2) are read only
+  if (bus.ppu != nullptr) {
+    bus.ppu->writeSTAT(val);
+    return;
+  }
+  uint8_t &stat = bus.memory[memoryOffset(addr)];
+  stat = (stat & 0x07) | (val & 0x78);
+  bus.markDirty(&stat);
+}
+
+void Bus::writeLYC(Bus &bus, uint16_t addr, uint8_t val) {
+  // The PPU compares it with LY
+  if (bus.ppu != nullptr) {
+    bus.ppu->writeLYC(val);
+    return;
+  }
+  bus.memory[memoryOffset(addr)] = val;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeLCDRegister(Bus &bus, uint16_t addr, uint8_t val) {
+  // The PPU draws up to now first, for writes part way through a line
+  if (bus.ppu != nullptr) {
+    bus.ppu->writeRegister(addr, val);
+    return;
+  }
+  bus.memory[memoryOffset(addr)] = val;
+  bus.markDirty(bus.memory + memoryOffset(addr));
+}
+
+void Bus::writeDMA(Bus &bus, uint16_t addr, uint8_t val) {
+  //  Copy 160 bytes from val * 0x100 into OAM, all at once as nothing can see
+  // OAM part way through yet (0xe000 and up is WRAM again)
+  bus.memory[memoryOffset(addr)] = val;
+  uint16_t source = val << 8;
+  if (source >= 0xe000) {
+    source = source - 0x2000;
+  }
+  uint8_t *oam = bus.memory + memoryOffset(0xfe00);
+  for (int i = 0; i < 0xa0; i++) {
+    oam[i] = bus.read8(source + i);
+  }
+  bus.markDirty(bus.memory + memoryOffset(addr));
+  bus.markDirty(oam);
+}
+
+void Bus::writeBoot(Bus &bus, uint16_t, uint8_t val) {
+  // Writing bit 0 turns the boot ROM off until reset
+  if (val & 0x01) {
+    bus.unmapBootROM();
+  }
+}
+
+void Bus::mapROM(const uint8_t *rom, size_t rom_size) {
+  //  Move backing memory to a buffer with room for the cartridge's external RAM
+  // after it, then repoint VRAM and WRAM at it
+  uint32_t ram_size = MBC::ramSize(rom);
+  uint8_t *old_memory = memory;
+  memory_size = base_memory_size + ram_size;
+  memory = new uint8_t[memory_size];
+  memcpy(memory, old_memory, base_memory_size);
+  memset(memory + base_memory_size, 0, ram_size);
+  delete[] old_memory;
+#ifdef GREGGB_DIRTY_PAGES
+  markAllDirty();
+#endif
+  mapVRAM();
+  mapPages(0xc0, 0xdf, memory + memoryOffset(0xc000));
+  mapPages(0xe0, 0xfd, memory + memoryOffset(0xc000));
+  // The MBC maps its first banks, read straight out of the cartridge's memory
+  delete mbc;
+  mbc = new MBC(*this, rom, rom_size, memory + base_memory_size, ram_size);
+}
+
+// Bank switching
+void Bus::mapLowROM(const uint8_t *bank) {
+  // The boot ROM stays over the first 256 bytes while it is mapped
+  if (low_rom != bank) {
+    low_rom = bank;
+    mapReadOnly(boot_rom_mapped ? 0x01 : 0x00, 0x3f, boot_rom_mapped ? bank + 0x100 : bank);
+    switched_regions = switched_regions | 0x03;
+  }
+}
+
+void Bus::mapHighROM(const uint8_t *bank) {
+  if (mapped[0x40].read != bank) {
+    mapReadOnly(0x40, 0x7f, bank);
+    switched_regions = switched_regions | 0x0c;
+  }
+}
+
+void Bus::mapExtRAM(uint8_t *bank, WriteHandler write) {
+  // Writes go to write instead of straight to bank if it isn't nullptr
+  if (mapped[0xa0].read != bank || (mapped[0xa0].write == nullptr) != (write != nullptr)) {
+    if (write != nullptr) {
+      mapReadOnly(0xa0, 0xbf, bank);
+      setHandlers(0xa0, 0xbf, &Bus::readOpenBus, write);
+    } else {
+      mapPages(0xa0, 0xbf, bank);
+    }
+    switched_regions = switched_regions | 0x20;
+  }
+}
+
+void Bus::unmapExtRAM(ReadHandler read, WriteHandler write) {
+  if (mapped[0xa0].read != nullptr || mapped[0xa0].read_handler != read
+  || mapped[0xa0].write_handler != write) {
+    for (int page = 0xa0; page <= 0xbf; page++) {
+      mapped[page].read = mapped[page].write = nullptr;
+    }
+    setHandlers(0xa0, 0xbf, read, write);
+    switched_regions = switched_regions | 0x20;
+  }
+}
+
+uint8_t Bus::takeSwitchedRegions() {
+  uint8_t regions = switched_regions;
+  switched_regions = 0;
+  return regions;
+}
+
+bool Bus::takePolledIO() {
+  bool polled = polled_io;
+  polled_io = false;
+  return polled;
+}
+
+const uint8_t* Bus::getHighROM() {
+  return mapped[0x40].read;
+}
+
+MBC* Bus::getMBC() {
+  return mbc;
+}
+
+void Bus::setPPU(PPU *ppu) {
+  this->ppu = ppu;
+}
+
+PPU* Bus::getPPU() {
+  return ppu;
+}
+
+void Bus::requestInterrupt(uint8_t bits) {
+  memory[high_offset + 0x0f] = memory[high_offset + 0x0f] | bits;
+  markDirty(memory + high_offset);
+}
+
+uint8_t* Bus::getBootROM() {
+  return boot_rom;
+}
+
+void Bus::unmapBootROM() {
+  // Page 0 goes back to the cartridge (open bus if there is none)
+  if (!boot_rom_mapped) {
+    return;
+  }
+  boot_rom_mapped = false;
+  mapped[0x00].read = low_rom;
+  updatePage(0x00);
+  switched_regions = switched_regions | 0x01;
+}
+
+bool Bus::bootROMMapped() {
+  return boot_rom_mapped;
+}
+
+void Bus::skipBoot() {
+  //  DMG I/O registers as the boot ROM leaves them (see Pan Docs, Power Up
+  // Sequence), the logo it draws is left out of VRAM
+  static const uint8_t io_after_boot[0x50] = {
+    0xcf, 0x00, 0x7e, 0xff, 0xab, 0x00, 0x00, 0xf8, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe1, // 0xff00
+    0x80, 0xbf, 0xf3, 0xff, 0xbf, 0xff, 0x3f, 0x00, 0xff, 0xbf, 0x7f, 0xff, 0x9f, 0xff, 0xbf, 0xff, // 0xff10
+    0xff, 0x00, 0x00, 0xbf, 0x77, 0xf3, 0xf1, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, // 0xff20
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // 0xff30
+    0x91, 0x85, 0x00, 0x00, 0x00, 0x00, 0xff, 0xfc, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff  // 0xff40
+  };
+  memcpy(memory + memoryOffset(0xff00), io_after_boot, sizeof(io_after_boot));
+  memory[memoryOffset(0xffff)] = 0x00;
+  markDirty(memory + memoryOffset(0xff00));
+  unmapBootROM();
+}
+
+uint8_t* Bus::getMemory() {
+  return memory;
+}
+
+uint32_t Bus::getMemorySize() {
+  return memory_size;
+}
+
+#ifdef GREGGB_DIRTY_PAGES
+void Bus::markAllDirty() {
+  memset(dirty_pages, 0xff, sizeof(dirty_pages));
+}
+
+void Bus::takeDirtyPages(std::vector<uint64_t> &pages) {
+  pages.assign(dirty_pages, dirty_pages + (memory_size / 256 + 63) / 64);
+  memset(dirty_pages, 0, sizeof(dirty_pages));
+}
+#endif
+
+// Watchpoints
+void Bus::addWatchpoint(uint16_t first, uint16_t last, uint8_t kinds) {
+  Watchpoint watchpoint;
+  watchpoint.first = first;
+  watchpoint.last = last;
+  watchpoint.kinds = kinds;
+  watchpoints.push_back(watchpoint);
+  updateWatched();
+}
+
+void Bus::removeWatchpoint(uint16_t first, uint16_t last, uint8_t kinds) {
+  for (size_t i = 0; i < watchpoints.size(); i++) {
+    if (watchpoints[i].first == first && watchpoints[i].last == last && watchpoints[i].kinds == kinds) {
+      watchpoints.erase(watchpoints.begin() + i);
+      break;
+    }
+  }
+  updateWatched();
+}
+
+void Bus::clearWatchpoints() {
+  watchpoints.clear();
+  updateWatched();
+}
+
+void Bus::setWatchHandler(WatchHandler handler, void *context) {
+  watch_handler = handler;
+  watch_context = context;
+}
+
+uint8_t Bus::watchedKinds(uint16_t addr) {
+  uint8_t kinds = 0;
+  for (const Watchpoint &watchpoint : watchpoints) {
+    if (addr >= watchpoint.first && addr <= watchpoint.last) {
+      kinds = kinds | watchpoint.kinds;
+    }
+  }
+  return kinds;
+}
+
+void Bus::updateWatched() {
+  // Work out which kinds each page has watched, then send those pages to the watch handlers
+  memset(watched, 0, sizeof(watched));
+  watching_exec = false;
+  for (const Watchpoint &watchpoint : watchpoints) {
+    for (int page = watchpoint.first >> 8; page <= watchpoint.last >> 8; page++) {
+      watched[page] = watched[page] | watchpoint.kinds;
+    }
+    watching_exec = watching_exec || (watchpoint.kinds & WATCH_EXEC);
+  }
+  for (int page = 0; page < 256; page++) {
+    updatePage(page);
+  }
+}
+
+void Bus::trap(uint16_t addr, WatchKind kind, uint8_t val) {
+  //  Only part of a watched page may be watched, so check the address is in a
+  // watchpoint before calling the handler
+  if (!(watchedKinds(addr) & kind)) {
+    return;
+  }
+  if (watch_handler != nullptr) {
+    watch_handler(watch_context, addr, kind, val);
+    return;
+  }
+  static const char *const names[5] = {"", "Read", "Write", "", "Execute"};
+  printf("Watchpoint: %s %04x (%02x)\n", names[kind], addr, val);
+}
+
+uint8_t Bus::peekSlow(uint16_t addr) {
+  // Read as mapped, skipping the watch handlers
+  if (addr >= 0xff00) {
+    ReadHandler handler = mapped_high_read[addr & 0xff];
+    if (handler == nullptr) {
+      return memory[high_offset + (addr & 0xff)];
+    }
+    return handler(*this, addr);
+  }
+  const Mapping &mapping = mapped[addr >> 8];
+  if (mapping.read != nullptr) {
+    return mapping.read[addr & 0xff];
+  }
+  return mapping.read_handler(*this, addr);
+}
+
+uint8_t Bus::readWatched(Bus &bus, uint16_t addr) {
+  uint8_t val = bus.peekSlow(addr);
+  bus.trap(addr, WATCH_READ, val);
+  return val;
+}
+
+void Bus::writeWatched(Bus &bus, uint16_t addr, uint8_t val) {
+  //  The handler sees the write before it happens, then it goes wherever it
+  // would have without the watchpoint
+  bus.trap(addr, WATCH_WRITE, val);
+  if (addr >= 0xff00) {
+    WriteHandler handler = bus.mapped_high_write[addr & 0xff];
+    if (handler == nullptr) {
+      bus.memory[high_offset + (addr & 0xff)] = val;
+      bus.markDirty(bus.memory + high_offset);
+      return;
+    }
+    handler(bus, addr, val);
+    return;
+  }
+  const Mapping &mapping = bus.mapped[addr >> 8];
+  if (mapping.write != nullptr) {
+    mapping.write[addr & 0xff] = val;
+    bus.markDirty(mapping.write);
+    return;
+  }
+  mapping.write_handler(bus, addr, val);
+}
+
+// Delete all Bus related objects
+Bus::~Bus() {
+  delete mbc;
+  delete[] memory;
+}
@@ -0,0 +1,274 @@
+/*
+Bus class function signatures
+*/
+
+#ifndef BUS_H
+#define BUS_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstddef>
+#include <vector>
+
+class MBC;
+class PPU;
+
+//  Build with -DGREGGB_DIRTY_PAGES to note which 256 byte pages of backing memory
+// have been written (see Bus::takeDirtyPages), so snapshots and caches only need
+// to look at those, without it the write path has no extra work at all
+
+//  Memory bus, every 256 byte page of the address space has a read and a write
+// pointer to host memory, so plain ROM and RAM are one table lookup away. Pages
+// with side effects (MBC registers in ROM, OAM and the unusable area, I/O) have
+// no pointer and go through the page's handler instead. Bank switching just
+// points the ROM or external RAM window's pages at another bank. Watchpoints
+// take the pointer away from only the pages they cover, so their accesses go
+// through the watch handlers and every other page is as fast as without them
+class Bus {
+  public:
+    // Slow path handlers, for pages with no host pointer
+    typedef uint8_t (*ReadHandler)(Bus &bus, uint16_t addr);
+    typedef void (*WriteHandler)(Bus &bus, uint16_t addr, uint8_t val);
+    //  Watchpoint kinds, reads and writes are caught by the bus, executes by the
+    // CPU just before the instruction at the address runs
+    enum WatchKind : uint8_t {WATCH_READ = 1, WATCH_WRITE = 2, WATCH_EXEC = 4};
+    //  Debugger callback, gets the address, the kind of access, and the byte read,
+    // about to be written, or the opcode about to run
+    typedef void (*WatchHandler)(void *context, uint16_t addr, WatchKind kind, uint8_t val);
+  private:
+    //  Backing memory only holds what each Game Boy can change, VRAM, WRAM, OAM,
+    // I/O, HRAM, and IE (base_memory_size bytes) then the cartridge's external RAM
+    // banks, ROM is read straight from a Cartridge shared by every Bus running it
+    static constexpr uint32_t base_memory_size = 0x4200;
+    uint8_t* memory; // Echo RAM shares WRAM's
+    uint32_t memory_size; // base_memory_size plus external RAM
+#ifdef GREGGB_DIRTY_PAGES
+    //  1 bit per 256 bytes of backing memory (bit n % 64 of word n / 64), set when
+    // written, sized for the most external RAM a cartridge can have (128KB)
+    static constexpr uint32_t max_memory_size = base_memory_size + 0x20000;
+    uint64_t dirty_pages[(max_memory_size / 256 + 63) / 64];
+    void markAllDirty();
+#endif
+    //  Boot ROM, mapped over the first 256 bytes of cartridge ROM until a write to
+    // 0xff50 turns it off
+    uint8_t boot_rom[256];
+    bool boot_rom_mapped;
+    const uint8_t* low_rom; // ROM bank at 0x0000-0x3fff (nullptr until mapROM)
+    MBC* mbc; // Cartridge's MBC (nullptr if none)
+    PPU* ppu; // PPU that LCD register writes go to (nullptr if none)
+    uint8_t switched_regions; // 8KB regions switched to another bank (1 bit each)
+    bool polled_io; // I/O register read that may change on its own (see takePolledIO)
+    // Host memory for each page (nullptr if the page's handler is used)
+    const uint8_t* read_page[256];
+    uint8_t* write_page[256];
+    ReadHandler read_handler[256];
+    WriteHandler write_handler[256];
+    //  Each page as mapped, the tables above are these with watched pages sent to
+    // the watch handlers instead
+    struct Mapping {
+      const uint8_t* read;
+      uint8_t* write;
+      ReadHandler read_handler;
+      WriteHandler write_handler;
+    };
+    Mapping mapped[256];
+    void updatePage(uint8_t page);
+    // Point pages first to last at host memory, readable and writable or read only
+    void mapPages(uint8_t first, uint8_t last, uint8_t *host);
+    void mapReadOnly(uint8_t first, uint8_t last, const uint8_t *host);
+    // Handlers for pages first to last (only used where there is no host pointer)
+    void setHandlers(uint8_t first, uint8_t last, ReadHandler read, WriteHandler write);
+    // Slow path handlers
+    static void writeMBC(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeVRAM(Bus &bus, uint16_t addr, uint8_t val);
+    //  Map VRAM (0x8000-0x9fff) at backing memory, writes to tile data go through
+    // writeVRAM so the PPU's decoded tiles can be kept up to date
+    void mapVRAM();
+    static uint8_t readOAM(Bus &bus, uint16_t addr);
+    static void writeOAM(Bus &bus, uint16_t addr, uint8_t val);
+    static uint8_t readHighPage(Bus &bus, uint16_t addr);
+    static void writeHighPage(Bus &bus, uint16_t addr, uint8_t val);
+    //  Handlers for each address in 0xff00-0xffff, I/O registers (0xff00-0xff7f)
+    // with side effects or bits that always read as 1 get one, the rest (and
+    // HRAM and IE) are nullptr and read and write backing memory directly
+    ReadHandler high_read[256];
+    WriteHandler high_write[256];
+    ReadHandler mapped_high_read[256]; // As mapped, before watchpoints
+    WriteHandler mapped_high_write[256];
+    static constexpr uint32_t high_offset = 0x4100; // memoryOffset(0xff00)
+    // I/O register handlers
+    static const uint8_t io_read_mask[0x80];
+    static uint8_t readMasked(Bus &bus, uint16_t addr);
+    static uint8_t readPolled(Bus &bus, uint16_t addr);
+    static uint8_t readJoypad(Bus &bus, uint16_t addr);
+    static void writeJoypad(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeDIV(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeNR52(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeLCDC(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeSTAT(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeLYC(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeLCDRegister(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeDMA(Bus &bus, uint16_t addr, uint8_t val);
+    static void writeBoot(Bus &bus, uint16_t addr, uint8_t val);
+    //  Watchpoints, watched holds the kinds watched anywhere in each page, and only
+    // pages with read or write watched are sent to the watch handlers
+    struct Watchpoint {
+      uint16_t first;
+      uint16_t last;
+      uint8_t kinds;
+    };
+    std::vector<Watchpoint> watchpoints;
+    uint8_t watched[256];
+    bool watching_exec;
+    WatchHandler watch_handler;
+    void* watch_context;
+    uint8_t watchedKinds(uint16_t addr);
+    void updateWatched();
+    void trap(uint16_t addr, WatchKind kind, uint8_t val);
+    uint8_t peekSlow(uint16_t addr);
+    static uint8_t readWatched(Bus &bus, uint16_t addr);
+    static void writeWatched(Bus &bus, uint16_t addr, uint8_t val);
+  public:
+    // Create Bus object
+    Bus();
+    // Read and write a byte
+    uint8_t read8(uint16_t addr) {
+      const uint8_t *page = read_page[addr >> 8];
+      if (page != nullptr) {
+        return page[addr & 0xff];
+      }
+      return read_handler[addr >> 8](*this, addr);
+    }
+    void write8(uint16_t addr, uint8_t val) {
+      uint8_t *page = write_page[addr >> 8];
+      if (page != nullptr) {
+        page[addr & 0xff] = val;
+        markDirty(page);
+        return;
+      }
+      write_handler[addr >> 8](*this, addr, val);
+    }
+    //  Read and write 0xff00 + index (I/O, HRAM, and IE), one table lookup for
+    // ldh and ld (0xff00+C) instead of going through the page table first
+    uint8_t readHigh(uint8_t index) {
+      ReadHandler handler = high_read[index];
+      if (handler == nullptr) {
+        return memory[high_offset + index];
+      }
+      return handler(*this, 0xff00 + index);
+    }
+    void writeHigh(uint8_t index, uint8_t val) {
+      WriteHandler handler = high_write[index];
+      if (handler == nullptr) {
+        memory[high_offset + index] = val;
+        markDirty(memory + high_offset);
+        return;
+      }
+      handler(*this, 0xff00 + index, val);
+    }
+    //  Read a byte without tripping watchpoints, for fetching and decoding
+    // instructions and for debugging dumps
+    uint8_t peek8(uint16_t addr) {
+      const uint8_t *page = read_page[addr >> 8];
+      if (page != nullptr) {
+        return page[addr & 0xff];
+      }
+      return peekSlow(addr);
+    }
+    //  Host pointer to addr if its page is plain memory (nullptr if it has a
+    // handler or is watched), for reading several bytes in one page with one lookup
+    const uint8_t* readPointer(uint16_t addr) {
+      const uint8_t *page = read_page[addr >> 8];
+      return page != nullptr ? page + (addr & 0xff) : nullptr;
+    }
+    //  Map cartridge ROM (rom_size bytes, whole 16KB banks, at least 2) and give
+    // it external RAM and the MBC its header asks for, the boot ROM stays at
+    // 0x0000-0x00ff
+    void mapROM(const uint8_t *rom, size_t rom_size);
+    //  Bank switching, point 0x0000-0x3fff (under the boot ROM while it is mapped),
+    // 0x4000-0x7fff (16KB banks), or 0xa000-0xbfff (8KB bank, writes can go
+    // through a handler) at another bank, or send 0xa000-0xbfff to handlers
+    void mapLowROM(const uint8_t *bank);
+    void mapHighROM(const uint8_t *bank);
+    void mapExtRAM(uint8_t *bank, WriteHandler write = nullptr);
+    void unmapExtRAM(ReadHandler read, WriteHandler write);
+    //  8KB regions (bit 0 for 0x0000-0x1fff up to bit 7) switched to another bank
+    // since the last call, code decoded from them is out of date
+    uint8_t takeSwitchedRegions();
+    //  Whether an I/O register other than IF, STAT, or LY was read since the last
+    // call, those are the only ones known not to change while the CPU runs up to
+    // the next PPU event (the timer, joypad, serial, and audio registers can)
+    bool takePolledIO();
+    // ROM bank mapped at 0x4000-0x7fff (nullptr until mapROM)
+    const uint8_t* getHighROM();
+    // Handlers for addresses nothing answers (reads 0xff, writes ignored)
+    static uint8_t readOpenBus(Bus &bus, uint16_t addr);
+    static void writeIgnored(Bus &bus, uint16_t addr, uint8_t val);
+    MBC* getMBC();
+    //  PPU to send LCD register writes to, which it needs to see as they happen
+    // (not owned by the Bus)
+    void setPPU(PPU *ppu);
+    PPU* getPPU();
+    // Request interrupts (IF bits)
+    void requestInterrupt(uint8_t bits);
+    // Boot ROM (256 bytes), for loading it
+    uint8_t* getBootROM();
+    //  Turn the boot ROM off (as writing 0xff50 does), putting cartridge ROM back
+    // at 0x0000-0x00ff
+    void unmapBootROM();
+    bool bootROMMapped();
+    // Skip the boot ROM, turning it off with I/O registers as it leaves them
+    void skipBoot();
+    // Backing memory (getMemorySize() bytes, external RAM last), for snapshots
+    uint8_t* getMemory();
+    uint32_t getMemorySize();
+    //  Note a write to backing memory at host, for handlers that write it
+    // themselves (does nothing without GREGGB_DIRTY_PAGES)
+    void markDirty(const uint8_t *host) {
+#ifdef GREGGB_DIRTY_PAGES
+      uint32_t page = (uint32_t)(host - memory) >> 8;
+      dirty_pages[page >> 6] = dirty_pages[page >> 6] | ((uint64_t)1 << (page & 63));
+#else
+      (void)host;
+#endif
+    }
+#ifdef GREGGB_DIRTY_PAGES
+    //  Whether the page holding backing memory offset was written since the last
+    // takeDirtyPages (everything starts out dirty, as does mapROM moving memory)
+    bool isDirty(uint32_t offset) {
+      return (dirty_pages[offset >> 14] >> ((offset >> 8) & 63)) & 1;
+    }
+    //  Copy the dirty bits (bit n % 64 of word n / 64 for the page at offset n *
+    // 256, getMemorySize() / 256 pages) into pages and clear them
+    void takeDirtyPages(std::vector<uint64_t> &pages);
+#endif
+    // Offset of addr in backing memory (0x8000-0x9fff, 0xc000-0xdfff, and 0xfe00-0xffff only)
+    static uint16_t memoryOffset(uint16_t addr) {
+      if (addr >= 0xfe00) {
+        return addr - 0xbe00;
+      }
+      return addr >= 0xc000 ? addr - 0xa000 : addr - 0x8000;
+    }
+    //  Watch first to last (inclusive) for the kinds of access in kinds (WatchKind
+    // bits), calling the watch handler on each one, removing takes the same
+    // range and kinds off again
+    void addWatchpoint(uint16_t first, uint16_t last, uint8_t kinds);
+    void removeWatchpoint(uint16_t first, uint16_t last, uint8_t kinds);
+    void clearWatchpoints();
+    // Debugger callback for watchpoints (nullptr prints each hit instead)
+    void setWatchHandler(WatchHandler handler, void *context);
+    //  Whether any watchpoint watches executes, the CPU only checks each
+    // instruction with checkExec while one does
+    bool watchingExec() {
+      return watching_exec;
+    }
+    void checkExec(uint16_t addr) {
+      if (watched[addr >> 8] & WATCH_EXEC) {
+        trap(addr, WATCH_EXEC, peek8(addr));
+      }
+    }
+    // Delete all Bus related objects
+    ~Bus();
+};
+
+#endif
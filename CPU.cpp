@@ -6,1231 +6,1889 @@ CPU class function definitions
 #include <cinttypes> // To use uint*_t
 #include <iostream>
 #include <cstdio>
+#include <algorithm>
+#include <cstring>
 // Include local header files
 #include "CPU.h"
+#ifdef GREGGB_JIT
+#include "JIT.h"
+#include "MBC.h"
+#include "PPU.h"
+#endif
+
+#if defined(GREGGB_THREADED_DISPATCH) || defined(GREGGB_SWITCH_DISPATCH)
+// Expand X once for every opcode 0x00 to 0xff (used to build threaded and switch dispatch)
+#define GREGGB_OPCODE_ROW(X, h) X(0x##h##0) X(0x##h##1) X(0x##h##2) X(0x##h##3) \
+  X(0x##h##4) X(0x##h##5) X(0x##h##6) X(0x##h##7) X(0x##h##8) X(0x##h##9) \
+  X(0x##h##a) X(0x##h##b) X(0x##h##c) X(0x##h##d) X(0x##h##e) X(0x##h##f)
+#define GREGGB_OPCODES(X) GREGGB_OPCODE_ROW(X, 0) GREGGB_OPCODE_ROW(X, 1) \
+  GREGGB_OPCODE_ROW(X, 2) GREGGB_OPCODE_ROW(X, 3) GREGGB_OPCODE_ROW(X, 4) \
+  GREGGB_OPCODE_ROW(X, 5) GREGGB_OPCODE_ROW(X, 6) GREGGB_OPCODE_ROW(X, 7) \
+  GREGGB_OPCODE_ROW(X, 8) GREGGB_OPCODE_ROW(X, 9) GREGGB_OPCODE_ROW(X, a) \
+  GREGGB_OPCODE_ROW(X, b) GREGGB_OPCODE_ROW(X, c) GREGGB_OPCODE_ROW(X, d) \
+  GREGGB_OPCODE_ROW(X, e) GREGGB_OPCODE_ROW(X, f)
+#endif
+
+#if defined(GREGGB_SWITCH_DISPATCH)
+// Case for an opcode, its handler is known here so it gets inlined into the switch
+#define GREGGB_OP_CASE(n) case n: \
+  cycles = ops[n](*this, bus, code[1] + (code[2] << 8)); \
+  break;
+#endif
+
+#if defined(GREGGB_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#ifdef GREGGB_LAZY_FLAGS_CHECK
+#define GREGGB_CHECK_FLAGS() checkFlags()
+#else
+#define GREGGB_CHECK_FLAGS()
+#endif
+// Label address for an opcode
+#define GREGGB_OP_LABEL(n) &&op_##n,
+//  Execute an opcode, then jump straight to the next opcode's label (opcode and
+// operand read through one page pointer, as step does)
+#define GREGGB_OP_BODY(n) op_##n: \
+  cycles = ops[n](*this, bus, code[1] + (code[2] << 8)); \
+  opcodes_run++; \
+  total_cycles = total_cycles + cycles; \
+  GREGGB_CHECK_FLAGS(); \
+  if (loop_back) i = i + skipIdle(bus, max_instructions - i - 1); \
+  if (++i == max_instructions || total_cycles >= run_target) return; \
+  code = fetchCode(bus, slow_code); \
+  goto *labels[code[0]];
+#endif
 
 // Create CPU object
 CPU::CPU() {
   // Initialize registers (char or uint8_t, portable and exact)
   // 0x for hex, 0b for bytes
   // F is flags register (only top 4 bits used, rest is blank)
-  A = B = C = D = E = F = H = L = 0;
+  reg.AF = reg.BC = reg.DE = reg.HL = 0;
   // Initialize program counter and stack pointer
-  PC = SP = 0;
+  reg.PC = reg.SP = 0;
+  // Lazy flags (nothing recorded yet)
+  lazy.op = FLAGS_NONE;
+  lazy.x = lazy.y = lazy.carry = 0;
+  check_F = 0;
+  // Block cache (empty, and only allocated when built with it)
+#ifdef GREGGB_BLOCK_CACHE
+  block_index.assign(65536, 0);
+  code_bits.assign(4096, 0);
+#endif
+  high_bank = nullptr;
+  high_index = nullptr;
+  blocks.resize(1); // Index 0 means no block
+  blocks_flushed = false;
+  // JIT (off until setJit)
+  jit = nullptr;
+  jit_enabled = false;
+  jit_lockstep = false;
+  // Idle loops (none found yet)
+  loop.reg = reg;
+  loop.cycles = 0;
+  loop.opcodes_run = 0;
+  loop.dirty = true;
+  loop_back = false;
   // ETC.
   opcodes_run = 0;
   cycles = 0;
   total_cycles = 0;
-  // PPU ETC.
-  //ppu_cycles = 0;
-  //sprites_scanned = 0;
-  //sprites_in_buffer = 0;
-  //obj_penalty = 0;
-  //wy_is_ly = 0;
+  run_target = 0;
 };
 
+// Opcode tables
+//  Each entry executes one instruction and returns the number of cycles it took,
+// so the CPU loop only has to index the table with the current byte. The tables
+// are built at compile time, any opcode not filled in falls through to debug
+constexpr CPU::OpTable CPU::makeOpTable() {
+  OpTable table = {};
+  for (int i = 0; i < 256; i++) {
+    table[i] = &CPU::unemulated;
+  }
+  table[0x00] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { cpu.reg.PC++; return 4; };
+  table[0x01] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r16_n16(n16, &cpu.reg.BC); };
+  table[0x02] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_A(cpu.reg.BC, bus); };
+  table[0x03] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r16(&cpu.reg.BC); };
+  table[0x04] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.B); };
+  table[0x05] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.B); };
+  table[0x06] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.B); };
+  table[0x0a] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r8_r16(&cpu.reg.A, cpu.reg.BC, bus); };
+  table[0x0c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.C); };
+  table[0x0d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.C); };
+  table[0x0e] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.C); };
+  table[0x11] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r16_n16(n16, &cpu.reg.DE); };
+  table[0x12] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_A(cpu.reg.DE, bus); };
+  table[0x13] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r16(&cpu.reg.DE); };
+  table[0x14] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.D); };
+  table[0x15] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.D); };
+  table[0x16] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.D); };
+  table[0x17] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rlca(); };
+  table[0x18] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.jr_cc_i8<4>(n16 & 0xff); };
+  table[0x1a] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r8_r16(&cpu.reg.A, cpu.reg.DE, bus); };
+  table[0x1c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.E); };
+  table[0x1d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.E); };
+  table[0x1e] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.E); };
+  table[0x20] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.jr_cc_i8<0>(n16 & 0xff); };
+  table[0x21] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r16_n16(n16, &cpu.reg.HL); };
+  table[0x22] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_HLID_r8<true>(cpu.reg.A, bus); };
+  table[0x23] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r16(&cpu.reg.HL); };
+  table[0x24] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.H); };
+  table[0x25] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.H); };
+  table[0x26] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.H); };
+  table[0x27] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.daa(); };
+  table[0x28] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.jr_cc_i8<2>(n16 & 0xff); };
+  table[0x2a] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r8_HLID<true>(&cpu.reg.A, bus); };
+  table[0x2c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r8(&cpu.reg.L); };
+  table[0x2d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.L); };
+  table[0x2e] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.L); };
+  table[0x30] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.jr_cc_i8<1>(n16 & 0xff); };
+  table[0x31] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r16_n16(n16, &cpu.reg.SP); };
+  table[0x32] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_HLID_r8<false>(cpu.reg.A, bus); };
+  table[0x33] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.inc_r16(&cpu.reg.SP); };
+  table[0x38] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.jr_cc_i8<3>(n16 & 0xff); };
+  table[0x3a] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r8_HLID<false>(&cpu.reg.A, bus); };
+  table[0x3d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.dec_r8(&cpu.reg.A); };
+  table[0x3e] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.ld_r8_n8(n16 & 0xff, &cpu.reg.A); };
+  table[0x40] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.B); };
+  table[0x41] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.B); };
+  table[0x42] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.B); };
+  table[0x43] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.B); };
+  table[0x44] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.B); };
+  table[0x45] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.B); };
+  table[0x47] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.B); };
+  table[0x48] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.C); };
+  table[0x49] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.C); };
+  table[0x4a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.C); };
+  table[0x4b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.C); };
+  table[0x4c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.C); };
+  table[0x4d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.C); };
+  table[0x4f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.C); };
+  table[0x50] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.D); };
+  table[0x51] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.D); };
+  table[0x52] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.D); };
+  table[0x53] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.D); };
+  table[0x54] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.D); };
+  table[0x55] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.D); };
+  table[0x57] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.D); };
+  table[0x58] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.E); };
+  table[0x59] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.E); };
+  table[0x5a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.E); };
+  table[0x5b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.E); };
+  table[0x5c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.E); };
+  table[0x5d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.E); };
+  table[0x5f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.E); };
+  table[0x60] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.H); };
+  table[0x61] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.H); };
+  table[0x62] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.H); };
+  table[0x63] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.H); };
+  table[0x64] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.H); };
+  table[0x65] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.H); };
+  table[0x67] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.H); };
+  table[0x68] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.L); };
+  table[0x69] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.L); };
+  table[0x6a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.L); };
+  table[0x6b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.L); };
+  table[0x6c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.L); };
+  table[0x6d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.L); };
+  table[0x6f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.L); };
+  table[0x70] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.B, cpu.reg.HL, bus); };
+  table[0x71] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.C, cpu.reg.HL, bus); };
+  table[0x72] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.D, cpu.reg.HL, bus); };
+  table[0x73] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.E, cpu.reg.HL, bus); };
+  table[0x74] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.H, cpu.reg.HL, bus); };
+  table[0x75] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.L, cpu.reg.HL, bus); };
+  table[0x76] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.halt(bus); };
+  table[0x77] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_r16_r8(cpu.reg.A, cpu.reg.HL, bus); };
+  table[0x78] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.B, &cpu.reg.A); };
+  table[0x79] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.C, &cpu.reg.A); };
+  table[0x7a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.D, &cpu.reg.A); };
+  table[0x7b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.E, &cpu.reg.A); };
+  table[0x7c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.H, &cpu.reg.A); };
+  table[0x7d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.L, &cpu.reg.A); };
+  table[0x7f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.ld_r8_dest_r8_src(cpu.reg.A, &cpu.reg.A); };
+  table[0x88] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.B); };
+  table[0x89] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.C); };
+  table[0x8a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.D); };
+  table[0x8b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.E); };
+  table[0x8c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.H); };
+  table[0x8d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.adc_a_r8(cpu.reg.L); };
+  table[0xa8] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.B); };
+  table[0xa9] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.C); };
+  table[0xaa] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.D); };
+  table[0xab] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.E); };
+  table[0xac] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.H); };
+  table[0xad] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.L); };
+  table[0xaf] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.xor_a_r8(cpu.reg.A); };
+  table[0xb8] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.B); };
+  table[0xb9] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.C); };
+  table[0xba] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.D); };
+  table[0xbb] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.E); };
+  table[0xbc] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.H); };
+  table[0xbd] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.L); };
+  table[0xbf] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.cp_A_n8_OR_r8<false>(cpu.reg.A); };
+  table[0xc0] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ret_cc<0>(bus); };
+  table[0xc1] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.pop_r16(&cpu.reg.BC, bus); };
+  table[0xc4] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.call_cc_n16<0>(n16, bus); };
+  table[0xc5] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.push_r16(cpu.reg.BC, bus); };
+  table[0xc8] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ret_cc<2>(bus); };
+  table[0xc9] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ret(bus); };
+  table[0xcc] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.call_cc_n16<2>(n16, bus); };
+  table[0xcd] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.call_cc_n16<4>(n16, bus); };
+  table[0xd0] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ret_cc<1>(bus); };
+  table[0xd1] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.pop_r16(&cpu.reg.DE, bus); };
+  table[0xd4] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.call_cc_n16<1>(n16, bus); };
+  table[0xd5] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.push_r16(cpu.reg.DE, bus); };
+  table[0xd8] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ret_cc<3>(bus); };
+  table[0xdc] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.call_cc_n16<3>(n16, bus); };
+  table[0xe0] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.ld_ff00_n8_A(n16 & 0xff, bus); };
+  table[0xe1] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.pop_r16(&cpu.reg.HL, bus); };
+  table[0xe2] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_ff00_C_A(bus); };
+  table[0xe5] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.push_r16(cpu.reg.HL, bus); };
+  table[0xea] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.ld_n16_r8(cpu.reg.A, n16, bus); };
+  table[0xf0] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cpu.ld_A_ff00_n8(n16 & 0xff, bus); };
+  table[0xf1] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { uint8_t cycles = cpu.pop_r16(&cpu.reg.AF, bus); cpu.setF(cpu.reg.F); return cycles; };
+  table[0xf2] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.ld_A_ff00_C(bus); };
+  table[0xf5] = [](CPU &cpu, Bus *bus, uint16_t) -> uint8_t { return cpu.push_r16((cpu.reg.A << 8) + cpu.getF(), bus); };
+  table[0xfe] = [](CPU &cpu, Bus *, uint16_t n16) -> uint8_t { return cpu.cp_A_n8_OR_r8<true>(n16 & 0xff); };
+  table[0xcb] = [](CPU &cpu, Bus *bus, uint16_t n16) -> uint8_t { return cb_table[n16 & 0xff](cpu, bus, n16); };
+  return table;
+}
+
+constexpr CPU::OpTable CPU::makeCBTable() {
+  OpTable table = {};
+  for (int i = 0; i < 256; i++) {
+    table[i] = &CPU::unemulatedCB;
+  }
+  table[0x10] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.B); };
+  table[0x11] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.C); };
+  table[0x12] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.D); };
+  table[0x13] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.E); };
+  table[0x14] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.H); };
+  table[0x15] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.L); };
+  table[0x17] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rl_r8(&cpu.reg.A); };
+  table[0x18] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.B); };
+  table[0x19] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.C); };
+  table[0x1a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.D); };
+  table[0x1b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.E); };
+  table[0x1c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.H); };
+  table[0x1d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.L); };
+  table[0x1f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.rr_r8(&cpu.reg.A); };
+  table[0x40] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_B>(); };
+  table[0x41] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_C>(); };
+  table[0x42] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_D>(); };
+  table[0x43] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_E>(); };
+  table[0x44] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_H>(); };
+  table[0x45] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_L>(); };
+  table[0x47] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<0, R8_A>(); };
+  table[0x48] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_B>(); };
+  table[0x49] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_C>(); };
+  table[0x4a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_D>(); };
+  table[0x4b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_E>(); };
+  table[0x4c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_H>(); };
+  table[0x4d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_L>(); };
+  table[0x4f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<1, R8_A>(); };
+  table[0x50] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_B>(); };
+  table[0x51] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_C>(); };
+  table[0x52] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_D>(); };
+  table[0x53] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_E>(); };
+  table[0x54] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_H>(); };
+  table[0x55] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_L>(); };
+  table[0x57] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<2, R8_A>(); };
+  table[0x58] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_B>(); };
+  table[0x59] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_C>(); };
+  table[0x5a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_D>(); };
+  table[0x5b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_E>(); };
+  table[0x5c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_H>(); };
+  table[0x5d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_L>(); };
+  table[0x5f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<3, R8_A>(); };
+  table[0x60] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_B>(); };
+  table[0x61] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_C>(); };
+  table[0x62] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_D>(); };
+  table[0x63] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_E>(); };
+  table[0x64] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_H>(); };
+  table[0x65] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_L>(); };
+  table[0x67] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<4, R8_A>(); };
+  table[0x68] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_B>(); };
+  table[0x69] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_C>(); };
+  table[0x6a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_D>(); };
+  table[0x6b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_E>(); };
+  table[0x6c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_H>(); };
+  table[0x6d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_L>(); };
+  table[0x6f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<5, R8_A>(); };
+  table[0x70] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_B>(); };
+  table[0x71] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_C>(); };
+  table[0x72] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_D>(); };
+  table[0x73] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_E>(); };
+  table[0x74] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_H>(); };
+  table[0x75] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_L>(); };
+  table[0x77] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<6, R8_A>(); };
+  table[0x78] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_B>(); };
+  table[0x79] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_C>(); };
+  table[0x7a] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_D>(); };
+  table[0x7b] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_E>(); };
+  table[0x7c] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_H>(); };
+  table[0x7d] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_L>(); };
+  table[0x7f] = [](CPU &cpu, Bus *, uint16_t) -> uint8_t { return cpu.bit_u3_r8<7, R8_A>(); };
+  return table;
+}
+
+const CPU::OpTable CPU::op_table = CPU::makeOpTable();
+const CPU::OpTable CPU::cb_table = CPU::makeCBTable();
+
+// ALU flag tables
+//  Flags for every result (adc/sbc) or operand (inc/dec) worked out once at
+// compile time, so ALU instructions set F with one load instead of testing each
+// flag. adc/sbc index by the 9 bit result rather than by both operands and carry
+// in, 512 entries instead of 128KB each, half carry is one xor of the operands
+constexpr CPU::CarryFlagTable CPU::makeAdcFlags() {
+  CarryFlagTable table = {};
+  for (int r = 0; r < 512; r++) {
+    // Z 0 - C, carry if the result went past bit 7
+    table[r] = ((r & 0xff) == 0) << 7 | (r >> 8) << 4;
+  }
+  return table;
+}
+
+constexpr CPU::CarryFlagTable CPU::makeSbcFlags() {
+  CarryFlagTable table = {};
+  for (int r = 0; r < 512; r++) {
+    // Z 1 - C, carry if the result borrowed (went below 0, so bit 8 is set)
+    table[r] = ((r & 0xff) == 0) << 7 | 1 << 6 | (r >> 8) << 4;
+  }
+  return table;
+}
+
+constexpr CPU::IncFlagTable CPU::makeIncFlags() {
+  IncFlagTable table = {};
+  for (int x = 0; x < 256; x++) {
+    // Z 0 H -, half carry if the low nibble was 0x0f
+    table[x] = ((uint8_t)(x + 1) == 0) << 7 | ((x & 0x0f) == 0x0f) << 5;
+  }
+  return table;
+}
+
+constexpr CPU::IncFlagTable CPU::makeDecFlags() {
+  IncFlagTable table = {};
+  for (int x = 0; x < 256; x++) {
+    // Z 1 H -, half carry (borrow) if the low nibble was 0
+    table[x] = ((uint8_t)(x - 1) == 0) << 7 | 1 << 6 | ((x & 0x0f) == 0) << 5;
+  }
+  return table;
+}
+
+constexpr CPU::DaaTable CPU::makeDaaTable() {
+  DaaTable table = {};
+  for (int i = 0; i < 2048; i++) {
+    int n = (i >> 10) & 1, h = (i >> 9) & 1, c = (i >> 8) & 1;
+    uint8_t A = i & 0xff;
+    //  After an add, correct each nibble that went past 9 (or carried), after a
+    // subtract, take back what borrowed
+    if (!n) {
+      if (c || A > 0x99) {
+        A = A + 0x60;
+        c = 1;
+      }
+      if (h || (A & 0x0f) > 0x09) {
+        A = A + 0x06;
+      }
+    } else {
+      if (c) {
+        A = A - 0x60;
+      }
+      if (h) {
+        A = A - 0x06;
+      }
+    }
+    // Z - 0 C
+    table[i] = A << 8 | (A == 0) << 7 | n << 6 | c << 4;
+  }
+  return table;
+}
+
+const CPU::CarryFlagTable CPU::adc_flags = CPU::makeAdcFlags();
+const CPU::CarryFlagTable CPU::sbc_flags = CPU::makeSbcFlags();
+const CPU::IncFlagTable CPU::inc_flags = CPU::makeIncFlags();
+const CPU::IncFlagTable CPU::dec_flags = CPU::makeDecFlags();
+const CPU::DaaTable CPU::daa_table = CPU::makeDaaTable();
+
+uint8_t CPU::adcFlags(uint8_t x, uint8_t y, uint8_t c) {
+  //  Z C from the adc table, half carry if bit 4 of the result differs from bit 4
+  // of x + y (so bit 3 carried into it)
+  uint16_t r = x + y + c;
+  return adc_flags[r] | ((x ^ y ^ r) & 0x10) << 1;
+}
+
+uint8_t CPU::sbcFlags(uint8_t x, uint8_t y, uint8_t c) {
+  // Z N C from the sbc table, half carry if bit 4 was borrowed from
+  uint16_t r = (x - y - c) & 0x1ff;
+  return sbc_flags[r] | ((x ^ y ^ r) & 0x10) << 1;
+}
+
+uint8_t CPU::incFlags(uint8_t x) {
+  return inc_flags[x];
+}
+
+uint8_t CPU::decFlags(uint8_t x) {
+  return dec_flags[x];
+}
+
+uint16_t CPU::daaResult(uint8_t A, uint8_t F) {
+  return daa_table[((F >> 4) & 0x07) << 8 | A];
+}
+
+uint8_t CPU::unemulated(CPU &cpu, Bus *bus, uint16_t) {
+  cpu.debug(bus, 0);
+  return 0;
+}
+
+uint8_t CPU::unemulatedCB(CPU &cpu, Bus *bus, uint16_t) {
+  cpu.debug(bus, 1);
+  return 0;
+}
+
 // CPU loop
-void CPU::cpuLoop(uint8_t* mem_map, uint32_t cycles_to_run) {
-  // For loop for CPU fetch, decode, execute process for 'cycles_to_run' cycles
-  for(uint32_t i = 0; i < cycles_to_run; i++) {
-    // printf("Opcode: %02x\n", mem_map[PC]); // DEBUG: Print current byte in hex
-    //  Switch statement that checks hex value of current byte, compares with
-    // opcode values, and then executes said opcode
-    switch (mem_map[PC]) {
-      case 0x00: PC++; cycles = 1; break;
-      case 0x01:
-        cycles = ld_r16_n16((mem_map[PC+2] << 8) + mem_map[PC+1], &B, &C, &PC);
-        break;
-      case 0x02:
-        cycles = ld_r16_A(&A, (C << 8) + B, &PC, mem_map);
-        break;
-      case 0x03:
-        cycles = inc_r16(&B, &C, &PC);
-        break;
-      case 0x04:
-        cycles = inc_r8(&B, &F, &PC);
-        break;
-      case 0x05:
-        cycles = dec_r8(&B, &F, &PC);
-        break;
-      case 0x06:
-        cycles = ld_r8_n8(mem_map[PC+1], &B, &PC);
-        break;
-      case 0x0a:
-        cycles = ld_r8_r16(&A, B, C, &PC, mem_map);
-        break;
-      case 0x0c:
-        cycles = inc_r8(&C, &F, &PC);
-        break;
-      case 0x0d:
-        cycles = dec_r8(&C, &F, &PC);
-        break;
-      case 0x0e:
-        cycles = ld_r8_n8(mem_map[PC+1], &C, &PC);
-        break;
-      case 0x11:
-        cycles = ld_r16_n16((mem_map[PC+2] << 8) + mem_map[PC+1], &D, &E, &PC);
-        break;
-      case 0x12:
-        cycles = ld_r16_A(&A, (E << 8) + D, &PC, mem_map);
-        break;
-      case 0x13:
-        cycles = inc_r16(&D, &E, &PC);
-        break;
-      case 0x14:
-        cycles = inc_r8(&D, &F, &PC);
-        break;
-      case 0x15:
-        cycles = dec_r8(&D, &F, &PC);
-        break;
-      case 0x16:
-        cycles = ld_r8_n8(mem_map[PC+1], &D, &PC);
-        break;
-      case 0x17:
-        cycles = rlca(&A, &F, &PC);
-        break;
-      case 0x18:
-        cycles = jr_cc_i8(mem_map[PC+1], F, 4, &PC, mem_map);
-        break;
-      case 0x1a:
-        cycles = ld_r8_r16(&A, D, E, &PC, mem_map);
-        break;
-      case 0x1c:
-        cycles = inc_r8(&E, &F, &PC);
-        break;
-      case 0x1d:
-        cycles = dec_r8(&E, &F, &PC);
-        break;
-      case 0x1e:
-        cycles = ld_r8_n8(mem_map[PC+1], &E, &PC);
-        break;
-      case 0x20:
-        cycles = jr_cc_i8(mem_map[PC+1], F, 0, &PC, mem_map);
-        break;
-      case 0x21:
-        cycles = ld_r16_n16((mem_map[PC+2] << 8) + mem_map[PC+1], &H, &L, &PC);
-        break;
-      case 0x22:
-        cycles = ld_HLID_r8(A, &H, &L, &PC, mem_map, 1);
-        break;
-      case 0x23:
-        cycles = inc_r16(&H, &L, &PC);
-        break;
-      case 0x24:
-        cycles = inc_r8(&H, &F, &PC);
-        break;
-      case 0x25:
-        cycles = dec_r8(&H, &F, &PC);
-        break;
-      case 0x26:
-        cycles = ld_r8_n8(mem_map[PC+1], &H, &PC);
-        break;
-      case 0x28:
-        cycles = jr_cc_i8(mem_map[PC+1], F, 2, &PC, mem_map);
-        break;
-      case 0x2a:
-        cycles = ld_r8_HLID(&A, &H, &L, &PC, mem_map, 1);
-        break;
-      case 0x2c:
-        cycles = inc_r8(&L, &F, &PC);
-        break;
-      case 0x2d:
-        cycles = dec_r8(&L, &F, &PC);
-        break;
-      case 0x2e:
-        cycles = ld_r8_n8(mem_map[PC+1], &L, &PC);
-        break;
-      case 0x30:
-        cycles = jr_cc_i8(mem_map[PC+1], F, 1, &PC, mem_map);
-        break;
-      case 0x31:
-        cycles = ld_SP_n16((mem_map[PC+2] << 8) + mem_map[PC+1], &SP, &PC);
-        break;
-      case 0x32:
-        cycles = ld_HLID_r8(A, &H, &L, &PC, mem_map, 0);
-        break;
-      case 0x33:
-        cycles = inc_SP(&SP, &PC);
-        break;
-      case 0x38:
-        cycles = jr_cc_i8(mem_map[PC+1], F, 3, &PC, mem_map);
-        break;
-      case 0x3a:
-        cycles = ld_r8_HLID(&A, &H, &L, &PC, mem_map, 0);
-        break;
-      case 0x3d:
-        cycles = dec_r8(&A, &F, &PC);
-        break;
-      case 0x3e:
-        cycles = ld_r8_n8(mem_map[PC+1], &A, &PC);
-        break;
-      case 0x40:
-        cycles = ld_r8_dest_r8_src(B, &B, &PC);
-        break;
-      case 0x41:
-        cycles = ld_r8_dest_r8_src(C, &B, &PC);
-        break;
-      case 0x42:
-        cycles = ld_r8_dest_r8_src(D, &B, &PC);
-        break;
-      case 0x43:
-        cycles = ld_r8_dest_r8_src(E, &B, &PC);
-        break;
-      case 0x44:
-        cycles = ld_r8_dest_r8_src(H, &B, &PC);
-        break;
-      case 0x45:
-        cycles = ld_r8_dest_r8_src(L, &B, &PC);
-        break;
-      case 0x47:
-        cycles = ld_r8_dest_r8_src(A, &B, &PC);
-        break;
-      case 0x48:
-        cycles = ld_r8_dest_r8_src(B, &C, &PC);
-        break;
-      case 0x49:
-        cycles = ld_r8_dest_r8_src(C, &C, &PC);
-        break;
-      case 0x4a:
-        cycles = ld_r8_dest_r8_src(D, &C, &PC);
-        break;
-      case 0x4b:
-        cycles = ld_r8_dest_r8_src(E, &C, &PC);
-        break;
-      case 0x4c:
-        cycles = ld_r8_dest_r8_src(H, &C, &PC);
-        break;
-      case 0x4d:
-        cycles = ld_r8_dest_r8_src(L, &C, &PC);
-        break;
-      case 0x4f:
-        cycles = ld_r8_dest_r8_src(A, &C, &PC);
-        break;
-      case 0x50:
-        cycles = ld_r8_dest_r8_src(B, &D, &PC);
-        break;
-      case 0x51:
-        cycles = ld_r8_dest_r8_src(C, &D, &PC);
-        break;
-      case 0x52:
-        cycles = ld_r8_dest_r8_src(D, &D, &PC);
-        break;
-      case 0x53:
-        cycles = ld_r8_dest_r8_src(E, &D, &PC);
-        break;
-      case 0x54:
-        cycles = ld_r8_dest_r8_src(H, &D, &PC);
-        break;
-      case 0x55:
-        cycles = ld_r8_dest_r8_src(L, &D, &PC);
-        break;
-      case 0x57:
-        cycles = ld_r8_dest_r8_src(A, &D, &PC);
-        break;
-      case 0x58:
-        cycles = ld_r8_dest_r8_src(B, &E, &PC);
-        break;
-      case 0x59:
-        cycles = ld_r8_dest_r8_src(C, &E, &PC);
-        break;
-      case 0x5a:
-        cycles = ld_r8_dest_r8_src(D, &E, &PC);
-        break;
-      case 0x5b:
-        cycles = ld_r8_dest_r8_src(E, &E, &PC);
-        break;
-      case 0x5c:
-        cycles = ld_r8_dest_r8_src(H, &E, &PC);
-        break;
-      case 0x5d:
-        cycles = ld_r8_dest_r8_src(L, &E, &PC);
-        break;
-      case 0x5f:
-        cycles = ld_r8_dest_r8_src(A, &E, &PC);
-        break;
-      case 0x60:
-        cycles = ld_r8_dest_r8_src(B, &H, &PC);
-        break;
-      case 0x61:
-        cycles = ld_r8_dest_r8_src(C, &H, &PC);
-        break;
-      case 0x62:
-        cycles = ld_r8_dest_r8_src(D, &H, &PC);
-        break;
-      case 0x63:
-        cycles = ld_r8_dest_r8_src(E, &H, &PC);
-        break;
-      case 0x64:
-        cycles = ld_r8_dest_r8_src(H, &H, &PC);
-        break;
-      case 0x65:
-        cycles = ld_r8_dest_r8_src(L, &H, &PC);
-        break;
-      case 0x67:
-        cycles = ld_r8_dest_r8_src(A, &H, &PC);
-        break;
-      case 0x68:
-        cycles = ld_r8_dest_r8_src(B, &L, &PC);
-        break;
-      case 0x69:
-        cycles = ld_r8_dest_r8_src(C, &L, &PC);
-        break;
-      case 0x6a:
-        cycles = ld_r8_dest_r8_src(D, &L, &PC);
-        break;
-      case 0x6b:
-        cycles = ld_r8_dest_r8_src(E, &L, &PC);
-        break;
-      case 0x6c:
-        cycles = ld_r8_dest_r8_src(H, &L, &PC);
-        break;
-      case 0x6d:
-        cycles = ld_r8_dest_r8_src(L, &L, &PC);
-        break;
-      case 0x6f:
-        cycles = ld_r8_dest_r8_src(A, &L, &PC);
-        break;
-      case 0x70:
-        cycles = ld_r16_r8(B, H, L, &PC, mem_map);
-        break;
-      case 0x71:
-        cycles = ld_r16_r8(C, H, L, &PC, mem_map);
-        break;
-      case 0x72:
-        cycles = ld_r16_r8(D, H, L, &PC, mem_map);
-        break;
-      case 0x73:
-        cycles = ld_r16_r8(E, H, L, &PC, mem_map);
-        break;
-      case 0x74:
-        cycles = ld_r16_r8(H, H, L, &PC, mem_map);
-        break;
-      case 0x75:
-        cycles = ld_r16_r8(L, H, L, &PC, mem_map);
-        break;
-      case 0x77:
-        cycles = ld_r16_r8(A, H, L, &PC, mem_map);
-        break;
-      case 0x78:
-        cycles = ld_r8_dest_r8_src(B, &A, &PC);
-        break;
-      case 0x79:
-        cycles = ld_r8_dest_r8_src(C, &A, &PC);
-        break;
-      case 0x7a:
-        cycles = ld_r8_dest_r8_src(D, &A, &PC);
-        break;
-      case 0x7b:
-        cycles = ld_r8_dest_r8_src(E, &A, &PC);
-        break;
-      case 0x7c:
-        cycles = ld_r8_dest_r8_src(H, &A, &PC);
-        break;
-      case 0x7d:
-        cycles = ld_r8_dest_r8_src(L, &A, &PC);
-        break;
-      case 0x7f:
-        cycles = ld_r8_dest_r8_src(A, &A, &PC);
-        break;
-      case 0x88:
-        cycles = adc_a_r8(&A, &B, &F, &PC);
-        break;
-      case 0x89:
-        cycles = adc_a_r8(&A, &C, &F, &PC);
-        break;
-      case 0x8a:
-        cycles = adc_a_r8(&A, &D, &F, &PC);
-        break;
-      case 0x8b:
-        cycles = adc_a_r8(&A, &E, &F, &PC);
-        break;
-      case 0x8c:
-        cycles = adc_a_r8(&A, &H, &F, &PC);
-        break;
-      case 0x8d:
-        cycles = adc_a_r8(&A, &L, &F, &PC);
-        break;
-      case 0xa8:
-        cycles = xor_a_r8(&A, &B, &F, &PC);
-        break;
-      case 0xa9:
-        cycles = xor_a_r8(&A, &C, &F, &PC);
-        break;
-      case 0xaa:
-        cycles = xor_a_r8(&A, &D, &F, &PC);
-        break;
-      case 0xab:
-        cycles = xor_a_r8(&A, &E, &F, &PC);
-        break;
-      case 0xac:
-        cycles = xor_a_r8(&A, &H, &F, &PC);
-        break;
-      case 0xad:
-        cycles = xor_a_r8(&A, &L, &F, &PC);
-        break;
-      case 0xaf:
-        cycles = xor_a_r8(&A, &A, &F, &PC);
-        break;
-      case 0xb8:
-        cycles = cp_A_n8_OR_r8(A, B, &F, &PC, 0);
-        break;
-      case 0xb9:
-        cycles = cp_A_n8_OR_r8(A, C, &F, &PC, 0);
-        break;
-      case 0xba:
-        cycles = cp_A_n8_OR_r8(A, D, &F, &PC, 0);
-        break;
-      case 0xbb:
-        cycles = cp_A_n8_OR_r8(A, E, &F, &PC, 0);
-        break;
-      case 0xbc:
-        cycles = cp_A_n8_OR_r8(A, H, &F, &PC, 0);
-        break;
-      case 0xbd:
-        cycles = cp_A_n8_OR_r8(A, L, &F, &PC, 0);
-        break;
-      case 0xbf:
-        cycles = cp_A_n8_OR_r8(A, A, &F, &PC, 0);
-        break;
-      case 0xc0:
-        cycles = ret_cc(F, 0, &SP, &PC, mem_map);
-        break;
-      case 0xc1:
-        cycles = pop_r16(&B, &C, &SP, &PC, mem_map);
-        break;
-      case 0xc4:
-        cycles = call_cc_n16((mem_map[PC+2] << 8) + mem_map[PC+1], F, 0, &SP, &PC, mem_map);
-        break;
-      case 0xc5:
-        cycles = push_r16(B, C, &SP, &PC, mem_map);
-        break;
-      case 0xc8:
-        cycles = ret_cc(F, 2, &SP, &PC, mem_map);
-        break;
-      case 0xc9:
-        cycles = ret(&SP, &PC, mem_map);
-        break;
-      case 0xcc:
-        cycles = call_cc_n16((mem_map[PC+2] << 8) + mem_map[PC+1], F, 2, &SP, &PC, mem_map);
-        break;
-      case 0xcd:
-        cycles = call_cc_n16((mem_map[PC+2] << 8) + mem_map[PC+1], F, 4, &SP, &PC, mem_map);
-        break;
-      case 0xd0:
-        cycles = ret_cc(F, 1, &SP, &PC, mem_map);
-        break;
-      case 0xd1:
-        cycles = pop_r16(&D, &E, &SP, &PC, mem_map);
-        break;
-      case 0xd4:
-        cycles = call_cc_n16((mem_map[PC+2] << 8) + mem_map[PC+1], F, 1, &SP, &PC, mem_map);
-        break;
-      case 0xd5:
-        cycles = push_r16(D, E, &SP, &PC, mem_map);
-        break;
-      case 0xd8:
-        cycles = ret_cc(F, 3, &SP, &PC, mem_map);
-        break;
-      case 0xdc:
-        cycles = call_cc_n16((mem_map[PC+2] << 8) + mem_map[PC+1], F, 3, &SP, &PC, mem_map);
-        break;
-      case 0xe0:
-        cycles = ld_ff00_n8_A(A, mem_map[PC+1], &PC, mem_map);
-        break;
-      case 0xe1:
-        cycles = pop_r16(&H, &L, &SP, &PC, mem_map);
-        break;
-      case 0xe2:
-        cycles = ld_ff00_C_A(A, C, &PC, mem_map);
-        break;
-      case 0xe5:
-        cycles = push_r16(H, L, &SP, &PC, mem_map);
-        break;
-      case 0xea:
-        cycles = ld_n16_r8(A, (mem_map[PC+2] << 8) + mem_map[PC+1], &PC, mem_map);
-        break;
-      case 0xf0:
-        cycles = ld_A_ff00_n8(&A, mem_map[PC+1], &PC, mem_map);
-        break;
-      case 0xf1:
-        cycles = pop_r16(&A, &F, &SP, &PC, mem_map);
-        break;
-      case 0xf2:
-        cycles = ld_A_ff00_C(&A, C, &PC, mem_map);
-        break;
-      case 0xf5:
-        cycles = push_r16(A, F, &SP, &PC, mem_map);
-        break;
-      case 0xfe:
-        cycles = cp_A_n8_OR_r8(A, mem_map[PC+1], &F, &PC, 1);
-        break;
-      case 0xcb:
-        // Debugging
-        // printf("Opcode: %02x\n", mem_map[PC]); // DEBUG: Print current byte in hex
-        switch (mem_map[PC+1]) {
-          case 0x10:
-            cycles = rl_r8(&B, &F, &PC);
-            break;
-          case 0x11:
-            cycles = rl_r8(&C, &F, &PC);
-            break;
-          case 0x12:
-            cycles = rl_r8(&D, &F, &PC);
-            break;
-          case 0x13:
-            cycles = rl_r8(&E, &F, &PC);
-            break;
-          case 0x14:
-            cycles = rl_r8(&H, &F, &PC);
-            break;
-          case 0x15:
-            cycles = rl_r8(&L, &F, &PC);
-            break;
-          case 0x17:
-            cycles = rl_r8(&A, &F, &PC);
-            break;
-          case 0x18:
-            cycles = rr_r8(&B, &F, &PC);
-            break;
-          case 0x19:
-            cycles = rr_r8(&C, &F, &PC);
-            break;
-          case 0x1a:
-            cycles = rr_r8(&D, &F, &PC);
-            break;
-          case 0x1b:
-            cycles = rr_r8(&E, &F, &PC);
-            break;
-          case 0x1c:
-            cycles = rr_r8(&H, &F, &PC);
-            break;
-          case 0x1d:
-            cycles = rr_r8(&L, &F, &PC);
-            break;
-          case 0x1f:
-            cycles = rr_r8(&A, &F, &PC);
-            break;
-          case 0x40:
-            cycles = bit_u3_r8(0, B, &F, &PC);
-            break;
-          case 0x41:
-            cycles = bit_u3_r8(0, C, &F, &PC);
-            break;
-          case 0x42:
-            cycles = bit_u3_r8(0, D, &F, &PC);
-            break;
-          case 0x43:
-            cycles = bit_u3_r8(0, E, &F, &PC);
-            break;
-          case 0x44:
-            cycles = bit_u3_r8(0, H, &F, &PC);
-            break;
-          case 0x45:
-            cycles = bit_u3_r8(0, L, &F, &PC);
-            break;
-          case 0x47:
-            cycles = bit_u3_r8(0, A, &F, &PC);
-            break;
-          case 0x48:
-            cycles = bit_u3_r8(1, B, &F, &PC);
-            break;
-          case 0x49:
-            cycles = bit_u3_r8(1, C, &F, &PC);
-            break;
-          case 0x4a:
-            cycles = bit_u3_r8(1, D, &F, &PC);
-            break;
-          case 0x4b:
-            cycles = bit_u3_r8(1, E, &F, &PC);
-            break;
-          case 0x4c:
-            cycles = bit_u3_r8(1, H, &F, &PC);
-            break;
-          case 0x4d:
-            cycles = bit_u3_r8(1, L, &F, &PC);
-            break;
-          case 0x4f:
-            cycles = bit_u3_r8(1, A, &F, &PC);
-            break;
-          case 0x50:
-            cycles = bit_u3_r8(2, B, &F, &PC);
-            break;
-          case 0x51:
-            cycles = bit_u3_r8(2, C, &F, &PC);
-            break;
-          case 0x52:
-            cycles = bit_u3_r8(2, D, &F, &PC);
-            break;
-          case 0x53:
-            cycles = bit_u3_r8(2, E, &F, &PC);
-            break;
-          case 0x54:
-            cycles = bit_u3_r8(2, H, &F, &PC);
-            break;
-          case 0x55:
-            cycles = bit_u3_r8(2, L, &F, &PC);
-            break;
-          case 0x57:
-            cycles = bit_u3_r8(2, A, &F, &PC);
-            break;
-          case 0x58:
-            cycles = bit_u3_r8(3, B, &F, &PC);
-            break;
-          case 0x59:
-            cycles = bit_u3_r8(3, C, &F, &PC);
-            break;
-          case 0x5a:
-            cycles = bit_u3_r8(3, D, &F, &PC);
-            break;
-          case 0x5b:
-            cycles = bit_u3_r8(3, E, &F, &PC);
-            break;
-          case 0x5c:
-            cycles = bit_u3_r8(3, H, &F, &PC);
-            break;
-          case 0x5d:
-            cycles = bit_u3_r8(3, L, &F, &PC);
-            break;
-          case 0x5f:
-            cycles = bit_u3_r8(3, A, &F, &PC);
-            break;
-          case 0x60:
-            cycles = bit_u3_r8(4, B, &F, &PC);
-            break;
-          case 0x61:
-            cycles = bit_u3_r8(4, C, &F, &PC);
-            break;
-          case 0x62:
-            cycles = bit_u3_r8(4, D, &F, &PC);
-            break;
-          case 0x63:
-            cycles = bit_u3_r8(4, E, &F, &PC);
-            break;
-          case 0x64:
-            cycles = bit_u3_r8(4, H, &F, &PC);
-            break;
-          case 0x65:
-            cycles = bit_u3_r8(4, L, &F, &PC);
-            break;
-          case 0x67:
-            cycles = bit_u3_r8(4, A, &F, &PC);
-            break;
-          case 0x68:
-            cycles = bit_u3_r8(5, B, &F, &PC);
-            break;
-          case 0x69:
-            cycles = bit_u3_r8(5, C, &F, &PC);
-            break;
-          case 0x6a:
-            cycles = bit_u3_r8(5, D, &F, &PC);
-            break;
-          case 0x6b:
-            cycles = bit_u3_r8(5, E, &F, &PC);
-            break;
-          case 0x6c:
-            cycles = bit_u3_r8(5, H, &F, &PC);
-            break;
-          case 0x6d:
-            cycles = bit_u3_r8(5, L, &F, &PC);
-            break;
-          case 0x6f:
-            cycles = bit_u3_r8(5, A, &F, &PC);
-            break;
-          case 0x70:
-            cycles = bit_u3_r8(6, B, &F, &PC);
-            break;
-          case 0x71:
-            cycles = bit_u3_r8(6, C, &F, &PC);
-            break;
-          case 0x72:
-            cycles = bit_u3_r8(6, D, &F, &PC);
-            break;
-          case 0x73:
-            cycles = bit_u3_r8(6, E, &F, &PC);
-            break;
-          case 0x74:
-            cycles = bit_u3_r8(6, H, &F, &PC);
-            break;
-          case 0x75:
-            cycles = bit_u3_r8(6, L, &F, &PC);
-            break;
-          case 0x77:
-            cycles = bit_u3_r8(6, A, &F, &PC);
-            break;
-          case 0x78:
-            cycles = bit_u3_r8(7, B, &F, &PC);
-            break;
-          case 0x79:
-            cycles = bit_u3_r8(7, C, &F, &PC);
-            break;
-          case 0x7a:
-            cycles = bit_u3_r8(7, D, &F, &PC);
-            break;
-          case 0x7b:
-            cycles = bit_u3_r8(7, E, &F, &PC);
-            break;
-          case 0x7c:
-            cycles = bit_u3_r8(7, H, &F, &PC);
-            break;
-          case 0x7d:
-            cycles = bit_u3_r8(7, L, &F, &PC);
-            break;
-          case 0x7f:
-            cycles = bit_u3_r8(7, A, &F, &PC);
-            break;
-          default:
-            debug(A, B, C, D, E, F, H, L, PC, SP, opcodes_run, total_cycles, mem_map, 1);
-        } 
-        total_cycles = total_cycles + cycles; // Add amount of cycles executed
-        break;
-      default:
-        debug(A, B, C, D, E, F, H, L, PC, SP, opcodes_run, total_cycles, mem_map, 0);
+void CPU::cpuLoop(Bus* bus, uint32_t instructions_to_run) {
+  // Run 'instructions_to_run' instructions (not cycles, see runUntil)
+  run(bus, instructions_to_run, UINT64_MAX);
+}
+
+void CPU::runUntil(Bus* bus, uint64_t target_cycle) {
+  //  Run until the clock reaches target_cycle, the last instruction can go past
+  // it, which the next call makes up for as the clock is never reset
+  run(bus, UINT32_MAX, target_cycle);
+}
+
+uint64_t CPU::getCycles() {
+  // T-cycles run since power on
+  return total_cycles;
+}
+
+void CPU::stopAt(uint64_t cycle) {
+  //  Bring the end of the current run forward, for an event scheduled by
+  // something the running code did (e.g. turning the LCD on)
+  if (cycle < run_target) {
+    run_target = cycle;
+  }
+}
+
+void CPU::run(Bus* bus, uint32_t max_instructions, uint64_t target_cycle) {
+  // Run until max_instructions have run or the clock reaches target_cycle
+  if (max_instructions == 0 || total_cycles >= target_cycle) {
+    return;
+  }
+  run_target = target_cycle; // stopAt may bring it forward
+  //  Memory may have been changed outside the CPU since the last run, so a pass
+  // of a loop only counts as idle if it ran entirely inside this one
+  loop.dirty = true;
+  loop_back = false;
+  //  Execute watchpoints need every instruction checked, so only then run the
+  // slower loop that does (reads and writes are caught by the bus)
+  if (bus->watchingExec()) {
+    runWatched(bus, max_instructions);
+    return;
+  }
+#if defined(GREGGB_BLOCK_CACHE)
+  //  Run predecoded blocks out of the block cache, a block is only run whole
+  // if it fits in what is left to run, otherwise single step
+  uint32_t i = 0;
+  while (i < max_instructions && total_cycles < run_target) {
+    uint16_t index = findBlock(reg.PC);
+    if (index == 0) {
+      index = buildBlock(bus);
+    }
+    if (index == 0 || blocks[index].ops > max_instructions - i
+    || blocks[index].ops * max_op_cycles > run_target - total_cycles) {
+      step(bus);
+      i++;
+    }
+#ifdef GREGGB_JIT
+    else if (jit_enabled) {
+      i = i + runJitBlock(index, bus);
+    }
+#endif
+    else {
+      i = i + runBlock(index, bus);
+    }
+    // Idle loops end on a jr or HALT, which end blocks, so check between blocks
+    if (loop_back) {
+      i = i + skipIdle(bus, max_instructions - i);
+    }
+  }
+#elif defined(GREGGB_THREADED_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+  //  Threaded dispatch (GCC/Clang computed goto), every opcode gets its own
+  // label that calls its table entry directly and then jumps straight to the
+  // next opcode's label, so each opcode has its own indirect jump to predict
+  static constexpr OpTable ops = makeOpTable();
+  static void* const labels[256] = { GREGGB_OPCODES(GREGGB_OP_LABEL) };
+  uint32_t i = 0;
+  uint8_t slow_code[3];
+  const uint8_t *code = fetchCode(bus, slow_code);
+  goto *labels[code[0]];
+  GREGGB_OPCODES(GREGGB_OP_BODY)
+#else
+  // For loop for CPU fetch, decode, execute process
+  for(uint32_t i = 0; i < max_instructions && total_cycles < run_target; i++) {
+    step(bus);
+    if (loop_back) {
+      i = i + skipIdle(bus, max_instructions - i - 1);
     }
-    opcodes_run++; // Add 1 to opcodes_run
-    total_cycles = total_cycles + cycles; // Add amount of cycles executed
-    //printf("A:%02x B:%02x C:%02x D:%02x E:%02x F:%02x H:%02x L:%02x Z:%x N:%x H:%x C:%x PC:%04x SP:%04x OPCODES RUN:%d TOTAL CYCLES:%d\n", A, B, C, D, E, F, H, L, (F >> 7) & 1, (F >> 6) & 1, (F >> 5) & 1, (F >> 4) & 1, PC, SP, opcodes_run, total_cycles);
-    //if (total_cycles >= 100000) { // DEBUG: To stop at a certain number of cycles
-    //  debug(A, B, C, D, E, F, H, L, PC, SP, opcodes_run, total_cycles, mem_map, 0);
-    //}
   }
+#endif
+};
+
+void CPU::runWatched(Bus* bus, uint32_t max_instructions) {
+  //  Single step, checking each instruction against the execute watchpoints
+  // before it runs, idle loops aren't skipped as that would skip their checks
+  for (uint32_t i = 0; i < max_instructions && total_cycles < run_target; i++) {
+    bus->checkExec(reg.PC);
+    step(bus);
+  }
+  loop_back = false;
+}
+
+uint32_t CPU::skipIdle(Bus *bus, uint32_t instructions_left) {
+  //  A pass of the loop changed nothing if it left the registers (and F) as the
+  // last one did without writing memory, then the next pass reads the same
+  // memory with the same registers and does the same thing. That only holds if
+  // what it read can't change on its own, so a pass that read an I/O register
+  // outside the ones PPU events change (IF, STAT, and LY) never counts
+  loop_back = false;
+  bool polled = bus->takePolledIO();
+  uint8_t F = getF();
+  bool idle = !loop.dirty && !polled && F == loop.reg.F && reg.A == loop.reg.A && reg.BC == loop.reg.BC
+  && reg.DE == loop.reg.DE && reg.HL == loop.reg.HL && reg.SP == loop.reg.SP
+  && reg.PC == loop.reg.PC;
+  uint64_t pass_cycles = total_cycles - loop.cycles;
+  uint32_t pass_instructions = opcodes_run - loop.opcodes_run;
+  loop.reg = reg;
+  loop.cycles = total_cycles;
+  loop.opcodes_run = opcodes_run;
+  loop.dirty = false;
+  if (!idle) {
+    return 0;
+  }
+  //  Nothing outside the CPU runs before run_target (the next PPU event at the
+  // latest), so IF, STAT, LY, and memory stay as they are and every pass up to
+  // it (or the instruction limit) is the same as the one just run, add their cycles
+  // and instructions without running them. Only whole passes are skipped, so the
+  // registers and clock end up exactly where running them would have left them
+  uint64_t passes = 0;
+  if (total_cycles < run_target) {
+    passes = (run_target - total_cycles) / pass_cycles;
+  }
+  passes = std::min<uint64_t>(passes, instructions_left / pass_instructions);
+  total_cycles = total_cycles + passes * pass_cycles;
+  opcodes_run = opcodes_run + passes * pass_instructions;
+  loop.cycles = total_cycles;
+  loop.opcodes_run = opcodes_run;
+  return passes * pass_instructions;
+}
+
+// Fetch, decode, and execute one instruction
+void CPU::step(Bus *bus) {
+  // printf("Opcode: %02x\n", bus->read8(reg.PC)); // DEBUG: Print current byte in hex
+  //  Index opcode table with current byte, which executes said opcode (opcode
+  // and operand read through one page pointer unless they cross a page)
+  uint8_t slow_code[3];
+  const uint8_t *code = fetchCode(bus, slow_code);
+#ifdef GREGGB_SWITCH_DISPATCH
+  //  Switch on the opcode instead (as cpuLoop did before the tables), to compare
+  // against with bench/cpu_bench
+  static constexpr OpTable ops = makeOpTable();
+  switch (code[0]) {
+    GREGGB_OPCODES(GREGGB_OP_CASE)
+  }
+#else
+  cycles = op_table[code[0]](*this, bus, code[1] + (code[2] << 8));
+#endif
+  opcodes_run++; // Add 1 to opcodes_run
+  total_cycles = total_cycles + cycles; // Add amount of cycles executed
+#ifdef GREGGB_LAZY_FLAGS_CHECK
+  checkFlags(); // Compare lazy and eager F after every instruction
+#endif
+  //printf("A:%02x B:%02x C:%02x D:%02x E:%02x F:%02x H:%02x L:%02x Z:%x N:%x H:%x C:%x PC:%04x SP:%04x OPCODES RUN:%d TOTAL CYCLES:%d\n", reg.A, reg.B, reg.C, reg.D, reg.E, reg.F, reg.H, reg.L, (reg.F >> 7) & 1, (reg.F >> 6) & 1, (reg.F >> 5) & 1, (reg.F >> 4) & 1, reg.PC, reg.SP, opcodes_run, total_cycles);
+  //if (total_cycles >= 100000) { // DEBUG: To stop at a certain number of cycles
+  //  debug(bus, 0);
+  //}
+}
+
+const uint8_t* CPU::fetchCode(Bus *bus, uint8_t *slow_code) {
+  //  Opcode and operand bytes at PC, straight from PC's page if it is plain memory
+  // and they don't run into the next page, otherwise peeked into slow_code
+  const uint8_t *code = bus->readPointer(reg.PC);
+  if (code != nullptr && (reg.PC & 0xff) < 0xfe) {
+    return code;
+  }
+  slow_code[0] = bus->peek8(reg.PC);
+  slow_code[1] = bus->peek8((uint16_t)(reg.PC + 1));
+  slow_code[2] = bus->peek8((uint16_t)(reg.PC + 2));
+  return slow_code;
+}
+
+uint16_t CPU::fetchOperand(Bus *bus) {
+  // The 2 bytes after the opcode (high byte ignored by 2 byte opcodes)
+  return bus->peek8((uint16_t)(reg.PC + 1)) + (bus->peek8((uint16_t)(reg.PC + 2)) << 8);
+}
+
+// Block cache
+// Length of each opcode in bytes
+const uint8_t CPU::op_length[256] = {
+  1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, // 0x00
+  2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x10
+  2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x20
+  2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 0x30
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x90
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xa0
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0xb0
+  1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // 0xc0
+  1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1, // 0xd0
+  2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1, // 0xe0
+  2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1  // 0xf0
 };
 
+//  T-cycles each opcode takes if it doesn't branch (conditional jumps, calls, and
+// returns not taken), 0xcb opcodes from cbCycles
+const uint8_t CPU::op_cycles[256] = {
+   4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4, // 0x00
+   4, 12,  8,  8,  4,  4,  8,  4, 12,  8,  8,  8,  4,  4,  8,  4, // 0x10
+   8, 12,  8,  8,  4,  4,  8,  4,  8,  8,  8,  8,  4,  4,  8,  4, // 0x20
+   8, 12,  8,  8, 12, 12, 12,  4,  8,  8,  8,  8,  4,  4,  8,  4, // 0x30
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0x40
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0x50
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0x60
+   8,  8,  8,  8,  8,  8,  4,  8,  4,  4,  4,  4,  4,  4,  8,  4, // 0x70
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0x80
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0x90
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0xa0
+   4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4, // 0xb0
+   8, 12, 12, 16, 12, 16,  8, 16,  8, 16, 12,  0, 12, 24,  8, 16, // 0xc0
+   8, 12, 12,  0, 12, 16,  8, 16,  8, 16, 12,  0, 12,  0,  8, 16, // 0xd0
+  12, 12,  8,  0,  0, 16,  8, 16, 16,  4, 16,  0,  0,  0,  8, 16, // 0xe0
+  12, 12,  8,  4,  0, 16,  8, 16, 12,  8, 16,  4,  0,  0,  8, 16  // 0xf0
+};
+
+uint8_t CPU::opCycles(uint8_t opcode, uint8_t cb_opcode) {
+  //  T-cycles an instruction takes if it doesn't branch, 0xcb ones take 8, or 16
+  // on (hl) (12 for bit, which only reads it)
+  if (opcode != 0xcb) {
+    return op_cycles[opcode];
+  }
+  if ((cb_opcode & 0x07) != 0x06) {
+    return 8;
+  }
+  return cb_opcode >= 0x40 && cb_opcode < 0x80 ? 12 : 16;
+}
+
+constexpr bool CPU::writesMemory(uint8_t opcode, uint8_t cb_opcode) {
+  //  Stores, inc/dec (hl), pushes (calls and restarts too), and 0xcb opcodes on
+  // (hl) other than bit can write memory
+  switch (opcode) {
+    case 0x02: case 0x08: case 0x12: case 0x22: case 0x32: case 0x34: case 0x35:
+    case 0x36: case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75:
+    case 0x77: case 0xc4: case 0xc5: case 0xc7: case 0xcc: case 0xcd: case 0xcf:
+    case 0xd4: case 0xd5: case 0xd7: case 0xdc: case 0xdf: case 0xe0: case 0xe2:
+    case 0xe5: case 0xe7: case 0xea: case 0xef: case 0xf5: case 0xf7: case 0xff:
+      return true;
+    case 0xcb:
+      return (cb_opcode & 0x07) == 0x06 && (cb_opcode < 0x40 || cb_opcode >= 0x80);
+    default:
+      return false;
+  }
+}
+
+bool CPU::endsBlock(uint8_t opcode) {
+  //  Jumps, calls, returns, restarts, halt, stop, and ei end a block, as the
+  // next instruction isn't the one after it in memory (or interrupts may run)
+  switch (opcode) {
+    case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: case 0x76:
+    case 0xc0: case 0xc2: case 0xc3: case 0xc4: case 0xc7: case 0xc8: case 0xc9:
+    case 0xca: case 0xcc: case 0xcd: case 0xcf: case 0xd0: case 0xd2: case 0xd4:
+    case 0xd7: case 0xd8: case 0xd9: case 0xda: case 0xdc: case 0xdf: case 0xe7:
+    case 0xe9: case 0xef: case 0xf7: case 0xfb: case 0xff:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint16_t CPU::findBlock(uint16_t pc) {
+  // Index of the block starting at pc (0 = none), 0x4000-0x7fff from the bank's index
+  if ((pc & 0xc000) == 0x4000) {
+    return high_index != nullptr ? high_index[pc - 0x4000] : 0;
+  }
+  return block_index[pc];
+}
+
+uint16_t CPU::buildBlock(Bus *bus) {
+  //  Decode instructions from PC up to and including the first one that ends a
+  // block, returns the block's index (0 if nothing could be decoded)
+  if (blocks.size() >= 65535) {
+    flushBlocks(); // Out of block indexes, start again
+  }
+  Block block;
+  block.first = block_insts.size();
+  block.count = 0;
+  block.ops = 0;
+  block.runs = 0;
+  block.cycles = 0;
+  block.code = nullptr;
+  uint16_t pc = reg.PC;
+  while (block.count < max_block_length) {
+    uint8_t opcode = bus->peek8(pc);
+    Instruction inst;
+    inst.n16 = bus->peek8((uint16_t)(pc + 1)) + (bus->peek8((uint16_t)(pc + 2)) << 8);
+    inst.length = op_length[opcode];
+    inst.ops = 1;
+    //  Resolve 0xcb opcodes to their cb_table entry, leave unemulated opcodes
+    // to the interpreter so debug sees the right PC
+    inst.handler = opcode == 0xcb ? cb_table[inst.n16 & 0xff] : op_table[opcode];
+    if (inst.handler == &CPU::unemulated || inst.handler == &CPU::unemulatedCB
+    || pc + inst.length > 0x10000) {
+      break;
+    }
+    inst.cycles = opCycles(opcode, inst.n16 & 0xff);
+    inst.writes = writesMemory(opcode, inst.n16 & 0xff);
+#ifdef GREGGB_SUPERINSTRUCTIONS
+    // Run a common sequence starting here as one entry (opcode becomes its last)
+    fuseInstruction(pc, bus, inst, opcode);
+#endif
+    //  End the block before it runs into another 8KB region, that region's bank
+    // may be switched on its own
+    if (block.count > 0 && ((pc + inst.length - 1) >> 13) != (reg.PC >> 13)) {
+      break;
+    }
+    // Mark the instruction's bytes in RAM as cached code, so writes to them flush
+    for (uint32_t addr = pc; addr < (uint32_t)pc + inst.length; addr++) {
+      uint16_t code_addr = codeAddr(addr);
+      if (code_addr >= 0x8000) {
+        code_bits[(code_addr - 0x8000) >> 3] |= 1 << (code_addr & 7);
+      }
+    }
+    inst.cycles_before = block.cycles;
+    block_insts.push_back(inst);
+#ifdef GREGGB_TRACE_SEQUENCES
+    block_keys.push_back(opcode == 0xcb ? 0xcb00 + (inst.n16 & 0xff) : opcode);
+#endif
+    block.count++;
+    block.ops = block.ops + inst.ops;
+    block.cycles = block.cycles + inst.cycles;
+    pc = pc + inst.length;
+    if (endsBlock(opcode)) {
+      break;
+    }
+  }
+  if (block.count == 0) {
+    return 0;
+  }
+  blocks.push_back(block);
+  if ((reg.PC & 0xc000) == 0x4000) {
+    // First block in this bank, give it an index
+    const uint8_t *bank = bus->getHighROM();
+    if (high_index == nullptr || bank != high_bank) {
+      std::vector<uint16_t> &index = bank_index[bank];
+      if (index.empty()) {
+        index.assign(0x4000, 0);
+      }
+      high_bank = bank;
+      high_index = index.data();
+    }
+    high_index[reg.PC - 0x4000] = blocks.size() - 1;
+  } else {
+    block_index[reg.PC] = blocks.size() - 1;
+  }
+  return blocks.size() - 1;
+}
+
+uint16_t CPU::runBlock(uint16_t index, Bus *bus) {
+  //  Run every instruction in a block, stop early if the block cache was flushed,
+  // returns the number of instructions run. Only the last instruction can branch,
+  // the ones before it take the cycles recorded when they were decoded, so the
+  // clock is only brought up to date before ones that can write memory (PPU
+  // register writes sync the PPU to it) and after the last one
+  blocks_flushed = false;
+  uint64_t start_cycles = total_cycles;
+  uint16_t block_ops = blocks[index].ops;
+  const Instruction *inst = &block_insts[blocks[index].first];
+  const Instruction *last = inst + blocks[index].count - 1;
+#ifdef GREGGB_TRACE_SEQUENCES
+  uint32_t first = blocks[index].first;
+#endif
+  uint16_t ops = 0;
+  for (; inst != last; inst++) {
+    ops = ops + inst->ops;
+    if (inst->writes) {
+      total_cycles = start_cycles + inst->cycles_before;
+      cycles = inst->handler(*this, bus, inst->n16);
+      //  A write over cached code or a bank switch throws the rest of the block
+      // away (inst included), so stop here
+      if (blocks_flushed) {
+        opcodes_run = opcodes_run + ops;
+        total_cycles = total_cycles + cycles;
+        return ops;
+      }
+    } else {
+      inst->handler(*this, bus, inst->n16);
+    }
+#ifdef GREGGB_LAZY_FLAGS_CHECK
+    checkFlags(); // Compare lazy and eager F after every instruction
+#endif
+#ifdef GREGGB_TRACE_SEQUENCES
+    countSequences(first, inst - block_insts.data());
+#endif
+  }
+  total_cycles = start_cycles + last->cycles_before;
+#ifdef GREGGB_TRACE_SEQUENCES
+  countSequences(first, last - block_insts.data());
+#endif
+  cycles = last->handler(*this, bus, last->n16);
+  opcodes_run = opcodes_run + block_ops; // Add instructions run to opcodes_run
+  total_cycles = total_cycles + cycles; // Add amount of cycles executed
+#ifdef GREGGB_LAZY_FLAGS_CHECK
+  checkFlags(); // Compare lazy and eager F after the last instruction
+#endif
+  return block_ops;
+}
+
+void CPU::flushBlocks() {
+  // Throw away every cached block
+  std::fill(block_index.begin(), block_index.end(), 0);
+  std::fill(code_bits.begin(), code_bits.end(), 0);
+  bank_index.clear();
+  high_bank = nullptr;
+  high_index = nullptr;
+  blocks.resize(1); // Index 0 means no block
+  block_insts.clear();
+#ifdef GREGGB_TRACE_SEQUENCES
+  block_keys.clear();
+#endif
+  blocks_flushed = true;
+#ifdef GREGGB_JIT
+  // Compiled code goes with the blocks it came from
+  if (jit != nullptr) {
+    jit->reset();
+  }
+#endif
+}
+
+uint16_t CPU::codeAddr(uint16_t addr) {
+  // Echo RAM is WRAM again, so code there is tracked at its WRAM address
+  if (addr >= 0xe000 && addr < 0xfe00) {
+    return addr - 0x2000;
+  }
+  return addr;
+}
+
+void CPU::write8(Bus *bus, uint16_t addr, uint8_t val) {
+  // Write to memory, drop cached blocks whose code was written over or switched out
+  bus->write8(addr, val);
+  loop.dirty = true; // The loop being run (if any) isn't idle
+#ifdef GREGGB_BLOCK_CACHE
+  //  ROM is read only, writes to it go to the MBC, which leaves the code there
+  // alone but may switch the banks code was decoded from out, as may I/O
+  // registers (0xff50 turns the boot ROM off)
+  if (addr >= 0x8000) {
+    uint16_t code_addr = codeAddr(addr) - 0x8000;
+    if (code_bits[code_addr >> 3] & (1 << (code_addr & 7))) {
+      flushBlocks();
+    }
+  }
+  if (addr < 0x8000 || addr >= 0xff00) {
+    uint8_t regions = bus->takeSwitchedRegions();
+    if (regions != 0) {
+      dropRegions(bus, regions);
+    }
+  }
+#endif
+}
+
+void CPU::writeHigh(Bus *bus, uint8_t index, uint8_t val) {
+  //  Write to 0xff00 + index, as write8 but I/O registers can only switch banks
+  // and HRAM can only hold code
+  bus->writeHigh(index, val);
+  loop.dirty = true; // The loop being run (if any) isn't idle
+#ifdef GREGGB_BLOCK_CACHE
+  if (index < 0x80) {
+    uint8_t regions = bus->takeSwitchedRegions();
+    if (regions != 0) {
+      dropRegions(bus, regions);
+    }
+    return;
+  }
+  uint16_t code_addr = 0x7f00 + index; // 0xff00 + index, from 0x8000
+  if (code_bits[code_addr >> 3] & (1 << (code_addr & 7))) {
+    flushBlocks();
+  }
+#endif
+}
+
+void CPU::dropRegions(Bus *bus, uint8_t regions) {
+  //  Throw away cached blocks starting in the 8KB regions set in regions (or in
+  // the last 2 bytes before them, where an instruction can run into one), blocks
+  // never run on into another region so the rest stay cached
+  if (regions & 0x0c) {
+    //  The ROM bank at 0x4000-0x7fff keeps its blocks under its own index, switch
+    // to the new bank's (if it has run before) instead
+    high_bank = bus->getHighROM();
+    auto bank = bank_index.find(high_bank);
+    high_index = bank != bank_index.end() ? bank->second.data() : nullptr;
+    block_index[0x3ffe] = block_index[0x3fff] = 0;
+    regions = regions & ~0x0c;
+  }
+  for (int region = 0; region < 8; region++) {
+    if (regions & (1 << region)) {
+      uint32_t first = region * 0x2000;
+      std::fill(block_index.begin() + (first < 2 ? 0 : first - 2), block_index.begin() + first + 0x2000, 0);
+      if (first >= 0x8000) {
+        std::fill(code_bits.begin() + (first - 0x8000) / 8, code_bits.begin() + (first - 0x6000) / 8, 0);
+      }
+    }
+  }
+  //  The running block (if any) was decoded from what was there before, so it
+  // stops here and the next instruction is fetched from the new bank
+  blocks_flushed = true;
+}
+
+// Superinstructions
+#ifdef GREGGB_SUPERINSTRUCTIONS
+//  Sequences fused into one handler, longest first where they share a start.
+// Picked from -DGREGGB_TRACE_SEQUENCES counts, times each ran from a block in
+// bench/cpu_bench (10M instructions: copy, fill, and countdown loops) and in
+// 60 frames of a boot ROM style VRAM clear followed by waiting for VBlank. The
+// operands of a sequence have to fit in its entry's n16, so ldh a,(n8), cp n8,
+// jr nz (waiting for VBlank) isn't one, skipIdle skips those loops anyway
+const CPU::Fusion CPU::fusions[] = {
+  {{0x05, 0x20}, 2, &CPU::fused<0x05, 0x20>}, // dec b, jr nz (2151266 in bench)
+  {{0x0d, 0x20}, 2, &CPU::fused<0x0d, 0x20>}, // dec c, jr nz (537792 in bench)
+  {{0x2a, 0x12, 0x13}, 3, &CPU::fused<0x2a, 0x12, 0x13>}, // ld a,(hl+), ld (de),a, inc de (1075648 in bench)
+  {{0x22, 0x05, 0x20}, 3, &CPU::fused<0x22, 0x05, 0x20>}, // ld (hl+),a, dec b, jr nz (1075618 in bench)
+  {{0x32, 0xcb7c, 0x20}, 3, &CPU::fused<0x32, 0xcb7c, 0x20>}, // ld (hl-),a, bit 7,h, jr nz (4673 in VRAM clear)
+};
+
+template <uint16_t... keys>
+uint8_t CPU::fused(CPU &cpu, Bus *bus, uint16_t n16) {
+  //  Run each instruction in the sequence, their handlers (0xcb ones too) are
+  // known here so they get inlined into this one instead of being dispatched one
+  // at a time, and their operands were packed into n16 in order when decoded.
+  // The clock is left where it was, runBlock adds the cycles returned
+  uint64_t start_cycles = cpu.total_cycles;
+  uint8_t cycles = cpu.fusedStep<keys...>(bus, n16, start_cycles);
+  cpu.total_cycles = start_cycles;
+  return cycles;
+}
+
+template <uint16_t key, uint16_t... rest>
+uint8_t CPU::fusedStep(Bus *bus, uint16_t operands, uint64_t clock) {
+  //  Run the next instruction of a fused sequence (its operand bytes at the bottom
+  // of operands) and then the rest, with the clock at clock if it can write
+  // memory (PPU register writes sync the PPU to it)
+  static constexpr OpTable ops = makeOpTable();
+  static constexpr OpTable cbs = makeCBTable();
+  constexpr uint8_t opcode = key > 0xff ? 0xcb : key;
+  constexpr bool writes = writesMemory(opcode, key & 0xff);
+  if constexpr (writes) {
+    total_cycles = clock;
+  }
+  uint8_t cycles;
+  if constexpr (opcode == 0xcb) {
+    cycles = cbs[key & 0xff](*this, bus, key & 0xff);
+  } else {
+    cycles = ops[opcode](*this, bus, operands);
+  }
+  if constexpr (sizeof...(rest) > 0) {
+    //  If it wrote over cached code the rest of the sequence may be gone, so fetch
+    // and decode the rest from memory instead like the interpreter would
+    if (writes && blocks_flushed) {
+      for (size_t i = 0; i < sizeof...(rest); i++) {
+        total_cycles = clock + cycles;
+        cycles = cycles + op_table[bus->peek8(reg.PC)](*this, bus, fetchOperand(bus));
+      }
+      return cycles;
+    }
+    uint8_t operand_bits = opcode == 0xcb ? 0 : 8 * (op_length[opcode] - 1);
+    cycles = cycles + fusedStep<rest...>(bus, operands >> operand_bits, clock + cycles);
+  }
+  return cycles;
+}
+
+bool CPU::fuseInstruction(uint16_t pc, Bus *bus, Instruction &inst, uint8_t &last_opcode) {
+  //  Turn inst into a fused entry if a sequence in fusions starts at pc, last_opcode
+  // is set to the sequence's last opcode (to check if it ends the block)
+  for (const Fusion &fusion : fusions) {
+    uint32_t addr = pc;
+    uint8_t opcode = 0;
+    uint8_t matched = 0;
+    uint8_t cycles = 0;
+    bool writes = false;
+    uint16_t operands = 0; // Operand bytes after the opcodes, packed in order
+    uint8_t operand_bits = 0;
+    while (matched < fusion.ops && addr < 0x10000) {
+      opcode = bus->peek8(addr);
+      uint8_t next = bus->peek8((uint16_t)(addr + 1));
+      uint16_t key = opcode == 0xcb ? 0xcb00 + next : opcode;
+      if (key != fusion.keys[matched]) {
+        break;
+      }
+      cycles = cycles + opCycles(opcode, next);
+      writes = writes || writesMemory(opcode, next);
+      if (opcode != 0xcb) {
+        for (uint32_t operand = addr + 1; operand < addr + op_length[opcode]; operand++) {
+          operands = operands | bus->peek8((uint16_t)operand) << operand_bits;
+          operand_bits = operand_bits + 8;
+        }
+      }
+      addr = addr + op_length[opcode];
+      matched++;
+    }
+    //  Sequences that run past the end of memory or into another 8KB region are
+    // left as separate instructions, its bank may be switched under them
+    if (matched < fusion.ops || addr > 0x10000 || (pc >> 13) != ((addr - 1) >> 13)) {
+      continue;
+    }
+    inst.handler = fusion.handler;
+    inst.n16 = operands;
+    inst.length = addr - pc;
+    inst.ops = fusion.ops;
+    inst.cycles = cycles;
+    inst.writes = writes;
+    last_opcode = opcode;
+    return true;
+  }
+  return false;
+}
+#endif
+
+// Sequence tracing
+#ifdef GREGGB_TRACE_SEQUENCES
+void CPU::countSequences(uint32_t first, uint32_t i) {
+  //  Count the pair and triple ending with block_insts entry i, in the block
+  // starting at first
+  if (i >= first + 1) {
+    sequence_counts[(uint64_t)2 << 48 | (uint64_t)block_keys[i - 1] << 16 | block_keys[i]]++;
+  }
+  if (i >= first + 2) {
+    sequence_counts[(uint64_t)3 << 48 | (uint64_t)block_keys[i - 2] << 32
+    | (uint64_t)block_keys[i - 1] << 16 | block_keys[i]]++;
+  }
+}
+#endif
+
+void CPU::printSequences(size_t top) {
+#ifdef GREGGB_TRACE_SEQUENCES
+  std::vector<std::pair<uint64_t, uint64_t>> counts(sequence_counts.begin(), sequence_counts.end());
+  std::sort(counts.begin(), counts.end(), [](const std::pair<uint64_t, uint64_t> &a, const std::pair<uint64_t, uint64_t> &b) {
+    return a.second > b.second;
+  });
+  for (uint64_t length = 2; length <= 3; length++) {
+    printf("Most run %s:\n", length == 2 ? "pairs" : "triples");
+    size_t printed = 0;
+    for (size_t i = 0; i < counts.size() && printed < top; i++) {
+      if (counts[i].first >> 48 != length) {
+        continue;
+      }
+      for (int shift = (length - 1) * 16; shift >= 0; shift = shift - 16) {
+        printf("%02x ", (unsigned)(counts[i].first >> shift & 0xffff));
+      }
+      printf("%" PRIu64 "\n", counts[i].second);
+      printed++;
+    }
+  }
+#else
+  (void)top;
+  printf("Error: Built without sequence tracing (build with -DGREGGB_TRACE_SEQUENCES)\n");
+  exit(1);
+#endif
+}
+
+// JIT
+void CPU::setJit(bool enabled, bool lockstep) {
+#ifdef GREGGB_JIT
+  if (enabled && jit == nullptr) {
+    jit = new JIT(16 * 1024 * 1024);
+  }
+  // Start from an empty cache so no block keeps code from an earlier JIT
+  flushBlocks();
+  jit_enabled = enabled;
+  jit_lockstep = lockstep;
+#else
+  (void)lockstep;
+  if (enabled) {
+    printf("Error: Built without JIT (build with -DGREGGB_JIT)\n");
+    exit(1);
+  }
+#endif
+}
+
+#ifdef GREGGB_JIT
+bool CPU::jitSuitable(uint16_t pc, uint16_t count, Bus *bus) {
+  //  Only compile blocks in ROM, code in RAM is more likely to be written over
+  // (and flushed) than run enough to pay for compiling it
+  if (pc >= 0x8000) {
+    return false;
+  }
+  //  Leave blocks that are mostly I/O reads and writes (ldh, ld to 0xff00 and
+  // up) to the interpreter, they're polling loops that gain nothing compiled
+  uint16_t io_count = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t opcode = bus->peek8(pc);
+    uint16_t n16 = bus->peek8((uint16_t)(pc + 1)) + (bus->peek8((uint16_t)(pc + 2)) << 8);
+    if (opcode == 0xe0 || opcode == 0xe2 || opcode == 0xf0 || opcode == 0xf2
+    || ((opcode == 0xea || opcode == 0xfa) && n16 >= 0xff00)) {
+      io_count++;
+    }
+    pc = pc + op_length[opcode];
+  }
+  return io_count * 2 <= count;
+}
+
+uint16_t CPU::runJitBlock(uint16_t index, Bus *bus) {
+  //  Run a block's compiled code, compiling it once it is hot, cold blocks and
+  // blocks that can't be compiled are interpreted, returns instructions run
+  Block &block = blocks[index];
+  if (block.code == nullptr && block.runs != jit_never && ++block.runs >= jit_threshold) {
+    if (jitSuitable(reg.PC, block.ops, bus)) {
+      block.code = jit->compile(*this, bus, &block_insts[block.first], block.count);
+      if (block.code == nullptr) {
+        flushBlocks(); // Code buffer is full, start again
+        return 0;
+      }
+    } else {
+      block.runs = jit_never;
+    }
+  }
+  if (block.code == nullptr) {
+    return runBlock(index, bus);
+  }
+  if (jit_lockstep) {
+    return runLockstep(index, bus);
+  }
+  //  Compiled code brings the clock up to date before instructions that can write
+  // memory, so the block's cycles are added to where it started
+  blocks_flushed = false;
+  uint64_t start_cycles = total_cycles;
+  uint64_t result = block.code(this, bus);
+  opcodes_run = opcodes_run + (result >> 32);
+  total_cycles = start_cycles + (uint32_t)result;
+#ifdef GREGGB_LAZY_FLAGS_CHECK
+  checkFlags(); // Compare lazy and eager F after the block
+#endif
+  return result >> 32;
+}
+
+uint16_t CPU::runLockstep(uint16_t index, Bus *bus) {
+  //  Run a block in the interpreter, then compiled from the same state, exit if
+  // registers, flags, memory, MBC and PPU state, cycles, or instructions run
+  // don't match. Frames the PPU publishes while the interpreter runs stay
+  // published, the compiled run draws the same lines again
+  Block block = blocks[index];
+  Registers start_reg = reg;
+  auto start_lazy = lazy;
+  uint8_t start_check_F = check_F;
+  auto start_loop = loop;
+  bool start_loop_back = loop_back;
+  uint32_t start_opcodes_run = opcodes_run;
+  uint64_t start_total_cycles = total_cycles;
+  uint64_t start_run_target = run_target;
+  uint8_t *memory = bus->getMemory();
+  uint32_t memory_size = bus->getMemorySize();
+  std::vector<uint8_t> start_mem(memory, memory + memory_size);
+  MBC *mbc = bus->getMBC();
+  PPU *ppu = bus->getPPU();
+  MBC::State start_mbc = {};
+  PPU::State start_ppu = {};
+  if (mbc != nullptr) {
+    start_mbc = mbc->getState();
+  }
+  if (ppu != nullptr) {
+    start_ppu = ppu->getState();
+  }
+  bool start_boot_rom = bus->bootROMMapped();
+  uint16_t count = runBlock(index, bus);
+  if (index >= blocks.size()) {
+    return count; // Block wrote over cached code, which flushed its compiled code too
+  }
+  if (start_boot_rom && !bus->bootROMMapped()) {
+    return count; // Turning the boot ROM off can't be taken back, so can't be compared
+  }
+  uint8_t interp_F = getF();
+  Registers interp_reg = reg;
+  uint32_t interp_cycles = total_cycles - start_total_cycles;
+  uint64_t interp_run_target = run_target;
+  std::vector<uint8_t> interp_mem(memory, memory + memory_size);
+  MBC::State interp_mbc = {};
+  PPU::State interp_ppu = {};
+  if (mbc != nullptr) {
+    interp_mbc = mbc->getState();
+  }
+  if (ppu != nullptr) {
+    interp_ppu = ppu->getState();
+  }
+  //  Back to where the block started (banks mapped as they were then, and tiles
+  // decoded again if VRAM was written), then run it compiled
+  reg = start_reg;
+  lazy = start_lazy;
+  check_F = start_check_F;
+  loop = start_loop;
+  loop_back = start_loop_back;
+  opcodes_run = start_opcodes_run;
+  total_cycles = start_total_cycles;
+  run_target = start_run_target;
+  uint16_t vram = Bus::memoryOffset(0x8000);
+  bool vram_written = memcmp(memory + vram, start_mem.data() + vram, 0x2000) != 0;
+  std::copy(start_mem.begin(), start_mem.end(), memory);
+  if (mbc != nullptr) {
+    mbc->setState(start_mbc);
+  }
+  if (ppu != nullptr) {
+    ppu->setState(start_ppu);
+    if (vram_written) {
+      ppu->vramChanged();
+    }
+  }
+  uint8_t regions = bus->takeSwitchedRegions();
+  if (regions != 0) {
+    dropRegions(bus, regions);
+  }
+  blocks_flushed = false;
+  uint64_t result = block.code(this, bus);
+  opcodes_run = opcodes_run + (result >> 32);
+  total_cycles = start_total_cycles + (uint32_t)result;
+  uint8_t F = getF();
+  MBC::State jit_mbc = {};
+  PPU::State jit_ppu = {};
+  if (mbc != nullptr) {
+    jit_mbc = mbc->getState();
+  }
+  if (ppu != nullptr) {
+    jit_ppu = ppu->getState();
+  }
+  if (F != interp_F || reg.A != interp_reg.A || reg.BC != interp_reg.BC || reg.DE != interp_reg.DE
+  || reg.HL != interp_reg.HL || reg.SP != interp_reg.SP || reg.PC != interp_reg.PC
+  || (uint32_t)result != interp_cycles || (result >> 32) != count || run_target != interp_run_target
+  || memcmp(memory, interp_mem.data(), memory_size) != 0
+  || (mbc != nullptr && memcmp(&jit_mbc, &interp_mbc, sizeof(MBC::State)) != 0)
+  || (ppu != nullptr && memcmp(&jit_ppu, &interp_ppu, sizeof(PPU::State)) != 0)) {
+    printf("JIT lockstep mismatch in block at %04x\n", start_reg.PC);
+    printf("Interpreter A:%02x F:%02x BC:%04x DE:%04x HL:%04x SP:%04x PC:%04x CYCLES:%d RUN:%d\n",
+    interp_reg.A, interp_F, interp_reg.BC, interp_reg.DE, interp_reg.HL, interp_reg.SP, interp_reg.PC, interp_cycles, count);
+    printf("JIT         A:%02x F:%02x BC:%04x DE:%04x HL:%04x SP:%04x PC:%04x CYCLES:%d RUN:%d\n",
+    reg.A, F, reg.BC, reg.DE, reg.HL, reg.SP, reg.PC, (uint32_t)result, (uint32_t)(result >> 32));
+    exit(1); // Exit program with error
+  }
+  return count;
+}
+#endif
+
 // Instruction functions
 // r8/r16 is any 8-bit/16-bit register
 // n8/n16 is a 8-bit/16-bit int constant
 // e8 is a 8-bit offset from -127 to 128
 // u3 is a 3-bit unsigned int constant
-uint8_t CPU::adc_a_r8(uint8_t *A, uint8_t *r8, uint8_t *F, uint16_t *PC) {
+template <uint8_t cc>
+bool CPU::condition() {
+  // Check condition cc (0=NZ, 1=NC, 2=Z, 3=C, 4=none)
+  if constexpr (cc == 4) {
+    return true;
+  } else if constexpr (cc == 0 || cc == 2) {
+    return ((getF() >> 7) & 1) == (cc == 2);
+  } else {
+    return ((getF() >> 4) & 1) == (cc == 3);
+  }
+}
+
+template <uint8_t r8_index>
+uint8_t &CPU::reg8() {
+  // 8-bit register from its index (R8_*)
+  static_assert(r8_index != R8_HL, "(HL) is memory, not a register");
+  if constexpr (r8_index == R8_B) {
+    return reg.B;
+  } else if constexpr (r8_index == R8_C) {
+    return reg.C;
+  } else if constexpr (r8_index == R8_D) {
+    return reg.D;
+  } else if constexpr (r8_index == R8_E) {
+    return reg.E;
+  } else if constexpr (r8_index == R8_H) {
+    return reg.H;
+  } else if constexpr (r8_index == R8_L) {
+    return reg.L;
+  } else {
+    return reg.A;
+  }
+}
+
+uint8_t CPU::adc_a_r8(uint8_t r8) {
   // Add A, r8, and the carry flag if set
-  // (*F >> 4) & 1 returns 1 if 4th bit is 1, and 0 if 0
-  *A = *A + *r8 + ((*F >> 4) & 1);
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  uint8_t carry = getCarry();
+  // Flags worked out later from A, r8, and carry (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_ADC, reg.A, r8, carry);
+  }
+  if (eager_flags) {
+    // Z 0 H C from the adc table and operands
+    eagerF() = adcFlags(reg.A, r8, carry);
+  }
+  reg.A = reg.A + r8 + carry;
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::bit_u3_r8(uint8_t u3, uint8_t r8, uint8_t *F, uint16_t *PC) {
+template <uint8_t u3, uint8_t r8_index>
+uint8_t CPU::bit_u3_r8() {
   // Test bit u3 in r8
-  uint8_t result = (r8 >> u3) & 1;
-  // printf("RESULT: %d\n", result); // DEBUG
-  // If said bit is 0, set zero flag in F, if not, clear it
-  switch (result) {
-    case 0:
-      *F |= 1 << 7;
-      break;
-    case 1: // Might be right, matches with BGB behaviour
-      *F &= !(1 << 7);
-      break;
+  uint8_t r8 = reg8<r8_index>();
+  // Flags worked out later from r8 and u3, carry flag is kept (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_BIT, r8, u3, getCarry());
+  }
+  if (eager_flags) {
+    uint8_t &F = eagerF();
+    uint8_t result = (r8 >> u3) & 1;
+    // printf("RESULT: %d\n", result); // DEBUG
+    // If said bit is 0, set zero flag in F, if not, clear it
+    switch (result) {
+      case 0:
+        F |= 1 << 7;
+        break;
+      case 1:
+        F &= ~(1 << 7);
+        break;
+    }
+    // Set subtraction flag to 0 and half carry flag to 1
+    F &= ~(1 << 6);
+    F |= 1 << 5;
   }
-  // Set subtraction flag to 0 and half carry flag to 1
-  *F &= ~(1 << 6);
-  *F |= 1 << 5;
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::call_cc_n16(int16_t n16, uint8_t F, uint8_t cc, uint16_t *SP, uint16_t *PC, uint8_t *mem_map) {
+template <uint8_t cc>
+uint8_t CPU::call_cc_n16(uint16_t n16, Bus *bus) {
   //  Call address n16, pushes address of next instruction (pointed by stack
   // pointer) to stack if cc is true (0=NZ, 1=NC, 2=Z, 3=C, 4=none), then jumps
   // to n16
-  if ((cc == 0 && (((F >> 7) & 1)) == 0) || (cc == 1 && (((F >> 4) & 1)) == 0)
-  || (cc == 2 && (((F >> 7) & 1)) == 1) || (cc == 3 && (((F >> 4) & 1)) == 1)
-  || cc == 4) {
-    *PC = *PC + 3; // 3 byte opcode, add 3 to PC
-    // Split program counter into high and low bytes
-    uint8_t PC_HIGH = (*PC >> 8) & 0xff;
-    uint8_t PC_LOW = *PC & 0xff;
-    // Add each byte in correct order to stack
-    mem_map[*SP - 1] = PC_HIGH;
-    mem_map[*SP - 2] = PC_LOW;
-    *PC = n16; // Jump to n16
-    *SP = *SP - 2; // Subtract 2 from stack pointer
+  if (condition<cc>()) {
+    reg.PC = reg.PC + 3; // 3 byte opcode, add 3 to PC
+    // Add high and low bytes of program counter in correct order to stack
+    write8(bus, (uint16_t)(reg.SP - 1), reg.PC >> 8);
+    write8(bus, (uint16_t)(reg.SP - 2), reg.PC & 0xff);
+    reg.PC = n16; // Jump to n16
+    reg.SP = reg.SP - 2; // Subtract 2 from stack pointer
     return 24; // Return number of cycles (in t-cycles)
   }
-  *PC = *PC + 3; // 3 byte opcode, add 3 to PC
+  reg.PC = reg.PC + 3; // 3 byte opcode, add 3 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::cp_A_n8_OR_r8(uint8_t A, uint8_t n8_OR_r8, uint8_t *F, uint16_t *PC, uint8_t is_n8) {
+template <bool is_n8>
+uint8_t CPU::cp_A_n8_OR_r8(uint8_t n8_OR_r8) {
   // Subtract n8_OR_r8 from A and set flags accordingly, but don't store result
-  // Set half carry flag if borrow from bit 4
-  switch (((A & 0x0f) - (n8_OR_r8 & 0x0f)) & 0x10) {
-    case 0x10:
-      *F |= 1 << 5;
-      break;
-    default:
-      *F &= ~(1 << 5);
+  // Flags worked out later from A and n8_OR_r8 (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_SUB, reg.A, n8_OR_r8, 0);
   }
-  // Set carry flag to 1 if n8_OR_r8 > A
-  if (n8_OR_r8 > A) {
-    *F |= 1 << 4;
-  } else {
-    *F &= ~(1 << 4);
-  }
-  // printf("BEFORE A:%02x n8_OR_r8: %02x\n", A, n8_OR_r8); // DEBUG
-  A = A - n8_OR_r8;
-  // printf("AFTER A:%02x n8_OR_r8: %02x\n", A, n8_OR_r8); // DEBUG
-  // printf("BEFORE F: %x\n", *F); // DEBUG
-  // If result is zero, set zero flag to 1, if not, 0
-  switch (A) {
-    case 0:
-      *F |= 1 << 7;
-      break;
-    default:
-      *F &= ~(1 << 7);
-  }
-  // Set subtraction flag to 1
-  *F |= 1 << 6;
-  // printf("AFTER F: %x\n", *F); // DEBUG
-  // Switch between n8 and r8 PC and cycle amount depending on is_n8's value
-  switch (is_n8) {
-    case 0: // r8
-      *PC = *PC + 1; // 1 byte opcode, add 1 to PC
-      return 4; // Return number of cycles (in t-cycles)
-      break;
-    case 1: // n8
-      *PC = *PC + 2; // 2 byte opcode, add 2 to PC
-      return 8; // Return number of cycles (in t-cycles)
-      break;
-    default:
-      printf("This shouldn't happen");
-      exit(1); // Exit program with error
+  if (eager_flags) {
+    // Z 1 H C from the sbc table and operands (no carry in)
+    eagerF() = sbcFlags(reg.A, n8_OR_r8, 0);
+  }
+  // n8 and r8 PC and cycle amount depending on is_n8's value
+  if (is_n8) {
+    reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
+    return 8; // Return number of cycles (in t-cycles)
   }
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
+  return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::dec_r8(uint8_t *r8, uint8_t *F, uint16_t *PC) {
+uint8_t CPU::daa() {
+  // Adjust A to binary coded decimal after an add or subtract (from N, H, and C)
+  uint16_t entry = daaResult(reg.A, getF());
+  reg.A = entry >> 8;
+  setF(entry & 0xff);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
+  return 4; // Return number of cycles (in t-cycles)
+}
+
+uint8_t CPU::dec_r8(uint8_t *r8) {
   // Decrease r8 by 1
-  // Set subtraction flag to 1 and half carry flag to 1 if borrow from bit 4
-  *F |= 1 << 6;
-  // If (r8 & 0x0f) 00001000 & 00001111 = 00001000 (bitmask top values)
-  // (1 & 0x0f) 00000001 & 00001111 = 00000001 (bitmask top values)
-  // 00001000 - 00000001 = 00000111
-  // 00000111 & 00010000 = 00000000 therefore no half borrow took place
-  // If (62 & 0x0f) 00111110 & 00001111 = 00001110 (bitmask top values)
-  // (34 & 0x0f) 00100010 & 00001111 = 00000010 (bitmask top values)
-  // 00001110 - 00000010 = 00001100
-  // 00001100 & 00010000 = 00000000 therefore no half borrow took place
-  // If (34 & 0x0f) 00100010 & 00001111 = 00000010 (bitmask top values)
-  // (62 & 0x0f) 00111110 & 00001111 = 00001110 (bitmask top values)
-  // 00000010 - 00001110 = 11110011
-  // 11110011 & 00010000 = 00010000 therefore half borrow took place (true?)
-  switch (((*r8 & 0x0f) - (1 & 0x0f)) & 0x10) {
-    case 0x10:
-      *F |= 1 << 5;
-      break;
-    default:
-      *F &= ~(1 << 5);
+  // Flags worked out later from r8 before decrease, carry flag is kept (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_DEC, *r8, 1, getCarry());
+  }
+  if (eager_flags) {
+    // Z 1 H from the dec table, carry flag is kept
+    uint8_t &F = eagerF();
+    F = (F & 0x10) | decFlags(*r8);
   }
   *r8 = *r8 - 1;
-  // Set zero flag to 1 if result is 0
-  switch (*r8) {
-    case 0:
-      *F |= 1 << 7;
-      break;
-    default:
-      *F &= ~(1 << 7);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
+  return 4; // Return number of cycles (in t-cycles)
+}
+
+uint8_t CPU::halt(Bus *bus) {
+  //  Wait until an interrupt is requested and enabled (IF & IE), HALT runs again
+  // every 4 t-cycles until then, interrupts aren't serviced yet so it carries on
+  // to the next instruction once one is
+  //  IF and IE are peeked, HALT checking them isn't a read the program made (so
+  // it doesn't trip read watchpoints every time round)
+  if ((bus->peek8(0xff0f) & bus->peek8(0xffff) & 0x1f) == 0) {
+    // Nothing in the CPU can request one, so this is an idle loop
+    loop_back = true;
+    return 4; // Return number of cycles (in t-cycles)
   }
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::inc_HL(uint8_t *HL, uint8_t *F, uint16_t *PC, uint8_t mem_map) {
+uint8_t CPU::inc_HL(Bus *bus) {
   // Increase byte pointed to by HL by 1
-  // Set subtraction flag to 0 and half carry flag to 1 if overflow from bit 3
-  *F &= ~(1 << 6);
-  // If (r8 & 0x0f) 00001000 & 00001111 = 00001000 (bitmask top values)
-  // (1 & 0x0f) 00000001 & 00001111 = 000000001 (bitmask top values)
-  // 00001000 + 00000001 = 00001001
-  // 00001001 & 00010000 = 00000000 therefore no half carry took place
-  // If (62 & 0x0f) 00111110 & 00001111 = 00001110 (bitmask top values)
-  // (34 & 0x0f) 00100010 & 00001111 = 00000010 (bitmask top values)
-  // 00001110 + 00000010 = 00010000
-  // 00010000 & 00010000 = 00010000 therefore half carry took place
-  switch (((mem_map[HL] & 0x000f) + (1 & 0x000f)) & 0x0010) {
-    case 0x0010:
-      *F |= 1 << 5;
-      break;
-    default:
-      *F &= ~(1 << 5);
+  uint8_t val = bus->read8(reg.HL);
+  // Flags worked out later from byte before increase, carry flag is kept (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_INC, val, 1, getCarry());
   }
-  mem_map[HL] = mem_map[HL] + 1;
-  // Set zero flag to 1 if result is 0
-  switch (mem_map[HL]) {
-    case 0:
-      *F |= 1 << 7;
-      break;
-    default:
-      *F &= ~(1 << 7);
+  if (eager_flags) {
+    // Z 0 H from the inc table, carry flag is kept
+    uint8_t &F = eagerF();
+    F = (F & 0x10) | incFlags(val);
   }
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  write8(bus, reg.HL, val + 1);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::inc_r16(uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC) {
+uint8_t CPU::inc_r16(uint16_t *r16) {
   // Increase r16 by 1
-  uint16_t r16 = (*r8_HIGH << 8) + *r8_LOW; // Join r8_HIGH and r8_LOW
-  r16 = r16 + 1;
-  // Split r8_HIGH and r8_LOW
-  *r8_HIGH = (r16 >> 8) & 0xff;
-  *r8_LOW = r16 & 0xff;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  *r16 = *r16 + 1;
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::inc_r8(uint8_t *r8, uint8_t *F, uint16_t *PC) {
+uint8_t CPU::inc_r8(uint8_t *r8) {
   // Increase r8 by 1
-  // Set subtraction flag to 0 and half carry flag to 1 if overflow from bit 3
-  *F &= ~(1 << 6);
-  // If (r8 & 0x0f) 00001000 & 00001111 = 00001000 (bitmask top values)
-  // (1 & 0x0f) 00000001 & 00001111 = 000000001 (bitmask top values)
-  // 00001000 + 00000001 = 00001001
-  // 00001001 & 00010000 = 00000000 therefore no half carry took place
-  // If (62 & 0x0f) 00111110 & 00001111 = 00001110 (bitmask top values)
-  // (34 & 0x0f) 00100010 & 00001111 = 00000010 (bitmask top values)
-  // 00001110 + 00000010 = 00010000
-  // 00010000 & 00010000 = 00010000 therefore half carry took place
-  switch (((*r8 & 0x0f) + (1 & 0x0f)) & 0x10) {
-    case 0x10:
-      *F |= 1 << 5;
-      break;
-    default:
-      *F &= ~(1 << 5);
+  // Flags worked out later from r8 before increase, carry flag is kept (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_INC, *r8, 1, getCarry());
   }
-  *r8 = *r8 + 1;
-  // Set zero flag to 1 if result is 0
-  switch (*r8) {
-    case 0:
-      *F |= 1 << 7;
-      break;
-    default:
-      *F &= ~(1 << 7);
+  if (eager_flags) {
+    // Z 0 H from the inc table, carry flag is kept
+    uint8_t &F = eagerF();
+    F = (F & 0x10) | incFlags(*r8);
   }
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  *r8 = *r8 + 1;
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::inc_SP(uint16_t *SP, uint16_t *PC) {
-  // Increase SP by 1
-  *SP = *SP + 1;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+uint8_t CPU::ld_A_ff00_C(Bus *bus) {
+  // Store 0xff00 + C in bus at A
+  reg.A = bus->readHigh(reg.C);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_A_ff00_C(uint8_t *A, uint8_t C, uint16_t *PC, uint8_t *mem_map) {
-  // Store 0xff00 + C in mem_map at A
-  *A = mem_map[0xff00 + C];
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
-  return 8; // Return number of cycles (in t-cycles)
-}
-
-uint8_t CPU::ld_A_ff00_n8(uint8_t *A, uint8_t n8, uint16_t *PC, uint8_t *mem_map) {
-  // Store 0xff00 + n8 in mem_map at A
-  *A = mem_map[0xff00 + n8];
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+uint8_t CPU::ld_A_ff00_n8(uint8_t n8, Bus *bus) {
+  // Store 0xff00 + n8 in bus at A
+  reg.A = bus->readHigh(n8);
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_ff00_C_A(uint8_t A, uint8_t C, uint16_t *PC, uint8_t *mem_map) {
-  // Store A at 0xff00 + C in mem_map
-  mem_map[0xff00 + C] = A;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+uint8_t CPU::ld_ff00_C_A(Bus *bus) {
+  // Store A at 0xff00 + C in bus
+  writeHigh(bus, reg.C, reg.A);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_ff00_n8_A(uint8_t A, uint8_t n8, uint16_t *PC, uint8_t *mem_map) {
-  // Store A at 0xff00 + n8 in mem_map
-  mem_map[0xff00 + n8] = A;
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+uint8_t CPU::ld_ff00_n8_A(uint8_t n8, Bus *bus) {
+  // Store A at 0xff00 + n8 in bus
+  writeHigh(bus, n8, reg.A);
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_HLID_r8(uint8_t r8, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC, uint8_t *mem_map, uint8_t is_increment) {
+template <bool is_increment>
+uint8_t CPU::ld_HLID_r8(uint8_t r8, Bus *bus) {
   // Store r8 at memory r16 (HL) points to, then increment or decrement HL
-  // printf("HIGH (BDH): %02x LOW (CEL): %02x\n", *r8_HIGH, *r8_LOW); // DEBUG
   // printf("r8 VAL: %02x", r8); // DEBUG
-  uint16_t r16 = (*r8_HIGH << 8) + *r8_LOW; // Join r8_HIGH and r8_LOW
-  mem_map[r16] = r8;
-  // printf("r16: %04x\n", r16); // DEBUG
-  // Check if HL should be incremented or decremented
-  switch (is_increment) {
-    case 0:
-      r16 = r16 - 1;
-      break;
-    case 1:
-      r16 = r16 + 1;
-      break;
-  }
-  // Split r8_HIGH and r8_LOW
-  *r8_HIGH = (r16 >> 8) & 0xff;
-  *r8_LOW = r16 & 0xff;
-  // printf("HIGH (BDH): %02x LOW (CEL): %02x\n", *r8_HIGH, *r8_LOW); // DEBUG
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  write8(bus, reg.HL, r8);
+  // printf("HL: %04x\n", reg.HL); // DEBUG
+  // Increment or decrement HL
+  reg.HL = is_increment ? reg.HL + 1 : reg.HL - 1;
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_n16_r8(uint8_t r8, uint16_t n16, uint16_t *PC, uint8_t *mem_map) {
+uint8_t CPU::ld_n16_r8(uint8_t r8, uint16_t n16, Bus *bus) {
   // Store r8 at memory n16 points to
-  mem_map[n16] = r8;
-  *PC = *PC + 3; // 3 byte opcode, add 3 to PC
+  write8(bus, n16, r8);
+  reg.PC = reg.PC + 3; // 3 byte opcode, add 3 to PC
   return 16; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r16_r8(uint8_t r8, uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *PC, uint8_t *mem_map) {
+uint8_t CPU::ld_r16_r8(uint8_t r8, uint16_t r16, Bus *bus) {
   // Store r8 at memory r16 points to
-  uint16_t r16 = (r8_HIGH << 8) + r8_LOW; // Join r8_HIGH and r8_LOW
-  mem_map[r16] = r8;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  write8(bus, r16, r8);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r8_HLID(uint8_t *r8, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC, uint8_t *mem_map, uint8_t is_increment) {
+template <bool is_increment>
+uint8_t CPU::ld_r8_HLID(uint8_t *r8, Bus *bus) {
   // Store memory r16 (HL) points to in r8, then increment or decrement HL
-  uint16_t r16 = (*r8_HIGH << 8) + *r8_LOW; // Join r8_HIGH and r8_LOW
-  *r8 = mem_map[r16];
-  // Check if HL should be incremented or decremented
-  switch (is_increment) {
-    case 0:
-      r16 = r16 - 1;
-      break;
-    case 1:
-      r16 = r16 + 1;
-      break;
-  }
-  // Split r8_HIGH and r8_LOW
-  *r8_HIGH = (r16 >> 8) & 0xff;
-  *r8_LOW = r16 & 0xff;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  *r8 = bus->read8(reg.HL);
+  // Increment or decrement HL
+  reg.HL = is_increment ? reg.HL + 1 : reg.HL - 1;
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r8_r16(uint8_t *r8, uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *PC, uint8_t *mem_map) {
+uint8_t CPU::ld_r8_r16(uint8_t *r8, uint16_t r16, Bus *bus) {
   // Store memory r16 points to in r8
-  uint16_t r16 = (r8_HIGH << 8) + r8_LOW; // Join r8_HIGH and r8_LOW
   // printf("r16 VAL:%04x\n", r16); // DEBUG
-  // printf("VAL r16 POINTS TO:%02x\n", mem_map[r16]); // DEBUG
-  *r8 = mem_map[r16];
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  // printf("VAL r16 POINTS TO:%02x\n", bus->read8(r16)); // DEBUG
+  *r8 = bus->read8(r16);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r8_dest_r8_src(uint8_t r8_src, uint8_t *r8_dest, uint16_t *PC) {
+uint8_t CPU::ld_r8_dest_r8_src(uint8_t r8_src, uint8_t *r8_dest) {
   // Set r8_dest to r8_src
   *r8_dest = r8_src;
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r16_n16(uint16_t n16, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC) {
-  // Set r16 to n16
-  // printf("HIGH (BDH): %02x LOW (CEL): %02x\n", *r8_HIGH, *r8_LOW); // DEBUG
-  uint16_t r16 = (*r8_HIGH << 8) + *r8_LOW; // Join r8_HIGH and r8_LOW
-  r16 = n16;
-  // printf("r16: %04x\n", r16); // DEBUG
-  // Split r8_HIGH and r8_LOW
-  *r8_HIGH = (r16 >> 8) & 0xff;
-  *r8_LOW = r16 & 0xff;
-  // printf("HIGH (BDH): %02x LOW (CEL): %02x\n", *r8_HIGH, *r8_LOW); // DEBUG
-  *PC = *PC + 3; // 3 byte opcode, add 3 to PC
+uint8_t CPU::ld_r16_n16(uint16_t n16, uint16_t *r16) {
+  // Set r16 (or SP) to n16
+  *r16 = n16;
+  // printf("r16: %04x\n", *r16); // DEBUG
+  reg.PC = reg.PC + 3; // 3 byte opcode, add 3 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r8_n8(uint8_t n8, uint8_t *r8, uint16_t *PC) {
+uint8_t CPU::ld_r8_n8(uint8_t n8, uint8_t *r8) {
   // Set r8 to n8
   // printf("n8: %02x\n", n8); // DEBUG
   *r8 = n8;
   // printf("r8: %02x\n", *r8); // DEBUG
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_r16_A(uint8_t *A, uint16_t r16, uint16_t *PC, uint8_t *mem_map) {
-  // Set A to value r16 points to
-  *A = mem_map[r16];
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+uint8_t CPU::ld_r16_A(uint16_t r16, Bus *bus) {
+  // Store A at memory r16 points to
+  write8(bus, r16, reg.A);
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ld_SP_n16(uint16_t n16, uint16_t *SP, uint16_t *PC) {
-  // Set SP to n16
-  *SP = n16;
-  *PC = *PC + 3; // 3 byte opcode, add 3 to PC
-  return 12; // Return number of cycles (in t-cycles)
-}
-
-uint8_t CPU::pop_r16(uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *SP, uint16_t *PC, uint8_t *mem_map) {
+uint8_t CPU::pop_r16(uint16_t *r16, Bus *bus) {
   //  Pop 2 bytes from stack into registers and have stack pointer be moved
   // back to how it was before the push
-  *r8_LOW = mem_map[*SP];
-  *r8_HIGH = mem_map[*SP + 1];
-  *SP = *SP + 2; // Add 2 to stack pointer
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  *r16 = bus->read8(reg.SP) + (bus->read8((uint16_t)(reg.SP + 1)) << 8);
+  reg.SP = reg.SP + 2; // Add 2 to stack pointer
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 12; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::push_r16(uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *SP, uint16_t *PC, uint8_t *mem_map) {
-  // Push r16 into stack
-  mem_map[*SP - 1] = r8_HIGH;
-  mem_map[*SP - 2] = r8_LOW;
-  *SP = *SP - 2; // Subtract 2 from stack pointer
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+uint8_t CPU::push_r16(uint16_t r16, Bus *bus) {
+  // Push r16 into stack (high byte first)
+  write8(bus, (uint16_t)(reg.SP - 1), r16 >> 8);
+  write8(bus, (uint16_t)(reg.SP - 2), r16 & 0xff);
+  reg.SP = reg.SP - 2; // Subtract 2 from stack pointer
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 16; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::jr_cc_i8(int8_t i8, uint8_t F, uint8_t cc, uint16_t *PC, uint8_t *mem_map) {
+template <uint8_t cc>
+uint8_t CPU::jr_cc_i8(int8_t i8) {
   // Jump to address i8 if cc is true (0=NZ, 1=NC, 2=Z, 3=C, 4=none)
-  if ((cc == 0 && (((F >> 7) & 1)) == 0) || (cc == 1 && (((F >> 4) & 1)) == 0)
-  || (cc == 2 && (((F >> 7) & 1)) == 1) || (cc == 3 && (((F >> 4) & 1)) == 1)
-  || cc == 4) {
+  if (condition<cc>()) {
     // printf("i8: %d\n", i8); // DEBUG
-    *PC = *PC + 2; // 2 byte opcode, add 2 to PC
-    *PC = *PC + i8;
-    // printf("PC: %d\n", *PC); // DEBUG
+    reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
+    reg.PC = reg.PC + i8;
+    // printf("PC: %d\n", reg.PC); // DEBUG
     // exit(1); // DEBUG
+    // Jumping back may be the end of a pass of a polling loop
+    if (i8 < 0) {
+      loop_back = true;
+    }
     return 12; // Return number of cycles (in t-cycles)
   }
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ret(uint16_t *SP, uint16_t *PC, uint8_t *mem_map) {
+uint8_t CPU::ret(Bus *bus) {
   //  Pop 2 bytes from stack into PC and have stack pointer be moved
   // back to how it was before the push
-  // Separate PC into PC_HIGH and PC_LOW
-  uint8_t PC_HIGH = (*PC >> 8) & 0xff;
-  uint8_t PC_LOW = *PC & 0xff;
-  PC_LOW = mem_map[*SP];
-  PC_HIGH = mem_map[*SP + 1];
-  *PC = (PC_HIGH << 8) + PC_LOW; // Join PC_HIGH and PC_LOW
-  *SP = *SP + 2; // Add 2 to stack pointer
-  // *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  reg.PC = bus->read8(reg.SP) + (bus->read8((uint16_t)(reg.SP + 1)) << 8);
+  reg.SP = reg.SP + 2; // Add 2 to stack pointer
   return 16; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::ret_cc(uint8_t F, uint8_t cc, uint16_t *SP, uint16_t *PC, uint8_t *mem_map) {
+template <uint8_t cc>
+uint8_t CPU::ret_cc(Bus *bus) {
   //  Pop 2 bytes from stack into PC and have stack pointer be moved
   // back to how it was before the push
-  // Do this if cc is true (0=NZ, 1=NC, 2=Z, 3=C, 4=none)
-  if ((cc == 0 && (((F >> 7) & 1)) == 0) || (cc == 1 && (((F >> 4) & 1)) == 0)
-  || (cc == 2 && (((F >> 7) & 1)) == 1) || (cc == 3 && (((F >> 4) & 1)) == 1)) {
-    // Separate PC into PC_HIGH and PC_LOW
-    uint8_t PC_HIGH = (*PC >> 8) & 0xff;
-    uint8_t PC_LOW = *PC & 0xff;
-    PC_LOW = mem_map[*SP];
-    PC_HIGH = mem_map[*SP + 1];
-    *PC = (PC_HIGH << 8) + PC_LOW; // Join PC_HIGH and PC_LOW
-    *SP = *SP + 2; // Add 2 to stack pointer
-    // *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  // Do this if cc is true (0=NZ, 1=NC, 2=Z, 3=C)
+  if (condition<cc>()) {
+    reg.PC = bus->read8(reg.SP) + (bus->read8((uint16_t)(reg.SP + 1)) << 8);
+    reg.SP = reg.SP + 2; // Add 2 to stack pointer
     return 20; // Return number of cycles (in t-cycles)
   }
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::rlca(uint8_t *A, uint8_t *F, uint16_t *PC) {
+uint8_t CPU::rlca() {
   // Rotate bits in A left through carry
-  // printf("A bitmasked: %02x\n", *r8 & 0x80); // DEBUG
-  uint8_t A_copy = *A; // Copy A into another variable to compare later
-  *A = *A << 1;
-  // If carry flag 1, add 1 to A
-  switch (*F & 0x10) {
-    case 0x10:
-      *A = *A + 1;
-      break;
+  uint8_t A_copy = reg.A; // Copy A into another variable to compare later
+  uint8_t carry = getCarry();
+  // Flags worked out later from A before rotate and carry (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_RLA, A_copy, 0, carry);
   }
-  //  Bitmask all of A_copy except for 7th bit, then make carry flag equal 1 or 0
-  // depending on what is in it (carry flag stores old 7th bit value, 0 or 1)
-  switch (A_copy & 0x80) {
-    case 0x80:
-      *F |= 1 << 4;
-      break;
-    default:
-      *F &= ~(1 << 4);
+  reg.A = (reg.A << 1) + carry; // If carry flag 1, add 1 to A
+  if (eager_flags) {
+    uint8_t &F = eagerF();
+    //  Bitmask all of A_copy except for 7th bit, then make carry flag equal 1 or 0
+    // depending on what is in it (carry flag stores old 7th bit value, 0 or 1)
+    switch (A_copy & 0x80) {
+      case 0x80:
+        F |= 1 << 4;
+        break;
+      default:
+        F &= ~(1 << 4);
+    }
+    // Clear zero, subtraction, and half carry flags
+    F &= ~(1 << 7);
+    F &= ~(1 << 6);
+    F &= ~(1 << 5);
   }
-  // Clear zero, subtraction, and half carry flags
-  *F &= ~(1 << 7);
-  *F &= ~(1 << 6);
-  *F &= ~(1 << 5);
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::rl_r8(uint8_t *r8, uint8_t *F, uint16_t *PC) {
+uint8_t CPU::rl_r8(uint8_t *r8) {
   // Rotate bits in r8 left through carry
-  // printf("r8 bitmasked: %02x\n", *r8 & 0x80); // DEBUG
   uint8_t r8_copy = *r8; // Copy r8 into another variable to compare later
-  *r8 = *r8 << 1;
-  // If carry flag 1, add 1 to r8
-  switch (*F & 0x10) {
-    case 0x10:
-      *r8 = *r8 + 1;
-      break;
-  }
-  //  Bitmask all of r8_copy except for 7th bit, then make carry flag equal 1 or 0
-  // depending on what is in it (carry flag stores old 7th bit value, 0 or 1)
-  switch (r8_copy & 0x80) {
-    case 0x80:
-      *F |= 1 << 4;
-      break;
-    default:
-      *F &= ~(1 << 4);
+  uint8_t carry = getCarry();
+  // Flags worked out later from r8 before rotate and carry (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_RL, r8_copy, 0, carry);
   }
-  // If r8 is 0, set zero flag to 1
-  switch (*r8) {
-    case 0:
-      *F |= 1 << 7;
+  *r8 = (*r8 << 1) + carry; // If carry flag 1, add 1 to r8
+  if (eager_flags) {
+    uint8_t &F = eagerF();
+    //  Bitmask all of r8_copy except for 7th bit, then make carry flag equal 1 or 0
+    // depending on what is in it (carry flag stores old 7th bit value, 0 or 1)
+    switch (r8_copy & 0x80) {
+      case 0x80:
+        F |= 1 << 4;
+        break;
+      default:
+        F &= ~(1 << 4);
+    }
+    // If r8 is 0, set zero flag to 1, if not, 0
+    switch (*r8) {
+      case 0:
+        F |= 1 << 7;
+        break;
+      default:
+        F &= ~(1 << 7);
+    }
+    // Clear subtraction and half carry flag
+    F &= ~(1 << 6);
+    F &= ~(1 << 5);
   }
-  // Clear subtraction and half carry flag
-  *F &= ~(1 << 6);
-  *F &= ~(1 << 5);
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::rr_r8(uint8_t *r8, uint8_t *F, uint16_t *PC) {
+uint8_t CPU::rr_r8(uint8_t *r8) {
   // Rotate bits in r8 right through carry
-  // printf("r8 bitmasked: %02x\n", *r8 & 0x01); // DEBUG
   uint8_t r8_copy = *r8; // Copy r8 into another variable to compare later
-  *r8 = *r8 >> 1;
-  // If carry flag 1, add 0x80 to r8
-  switch (*F & 0x10) {
-    case 0x10:
-      *r8 = *r8 + 0x80;
-      break;
-  }
-  //  Bitmask all of r8_copy except for 7th bit, then make carry flag equal 1 or 0
-  // depending on what is in it (carry flag stores old 7th bit value, 0 or 1)
-  switch (r8_copy & 0x01) {
-    case 0x01:
-      *F |= 1 << 4;
-      break;
-    default:
-      *F &= ~(1 << 4);
+  uint8_t carry = getCarry();
+  // Flags worked out later from r8 before rotate and carry (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_RR, r8_copy, 0, carry);
   }
-  // If r8 is 0, set zero flag to 1
-  switch (*r8) {
-    case 0:
-      *F |= 1 << 7;
+  *r8 = (*r8 >> 1) + (carry << 7); // If carry flag 1, add 0x80 to r8
+  if (eager_flags) {
+    uint8_t &F = eagerF();
+    //  Bitmask all of r8_copy except for 0th bit, then make carry flag equal 1 or 0
+    // depending on what is in it (carry flag stores old 0th bit value, 0 or 1)
+    switch (r8_copy & 0x01) {
+      case 0x01:
+        F |= 1 << 4;
+        break;
+      default:
+        F &= ~(1 << 4);
+    }
+    // If r8 is 0, set zero flag to 1, if not, 0
+    switch (*r8) {
+      case 0:
+        F |= 1 << 7;
+        break;
+      default:
+        F &= ~(1 << 7);
+    }
+    // Clear subtraction and half carry flag
+    F &= ~(1 << 6);
+    F &= ~(1 << 5);
   }
-  // Clear subtraction and half carry flag
-  *F &= ~(1 << 6);
-  *F &= ~(1 << 5);
-  *PC = *PC + 2; // 2 byte opcode, add 2 to PC
+  reg.PC = reg.PC + 2; // 2 byte opcode, add 2 to PC
   return 8; // Return number of cycles (in t-cycles)
 }
 
-uint8_t CPU::xor_a_r8(uint8_t *A, uint8_t *r8, uint8_t *F, uint16_t *PC) {
-  // Bitwise XOR r8 and A
-  uint8_t result = *r8 ^ *A;
-  switch (result) {
-    case 0:
-      *F |= 1 << 7;
+uint8_t CPU::xor_a_r8(uint8_t r8) {
+  // Bitwise XOR r8 and A, store result in A
+  reg.A = r8 ^ reg.A;
+  // Flags worked out later from result (lazy flags)
+  if (lazy_flags) {
+    deferFlags(FLAGS_XOR, reg.A, 0, 0);
   }
-  *PC = *PC + 1; // 1 byte opcode, add 1 to PC
+  if (eager_flags) {
+    uint8_t &F = eagerF();
+    // Set zero flag to 1 if result is 0, clear the rest
+    switch (reg.A) {
+      case 0:
+        F = 1 << 7;
+        break;
+      default:
+        F = 0;
+    }
+  }
+  reg.PC = reg.PC + 1; // 1 byte opcode, add 1 to PC
   return 4; // Return number of cycles (in t-cycles)
 }
 
+// Lazy flags
+//  With GREGGB_LAZY_FLAGS, ALU instructions record the operation and operands
+// they used instead of setting F, and F is only worked out when something reads
+// it (conditional jumps, push AF, adc, rotates through carry). lazyF works flags
+// out by hand rather than from the ALU flag tables, so checking lazy flags also
+// checks the tables
+void CPU::deferFlags(uint8_t op, uint8_t x, uint8_t y, uint8_t carry) {
+  lazy.op = op;
+  lazy.x = x;
+  lazy.y = y;
+  lazy.carry = carry;
+}
+
+uint8_t CPU::lazyF() {
+  // Work out F from the last recorded operation
+  uint8_t x = lazy.x;
+  uint8_t y = lazy.y;
+  uint8_t c = lazy.carry;
+  switch (lazy.op) {
+    case FLAGS_ADC: // Z 0 H C
+      return ((uint8_t)(x + y + c) == 0) << 7 | (((x & 0x0f) + (y & 0x0f) + c) > 0x0f) << 5
+      | (x + y + c > 0xff) << 4;
+    case FLAGS_SUB: // Z 1 H C
+      return ((uint8_t)(x - y - c) == 0) << 7 | 1 << 6 | ((x & 0x0f) < (y & 0x0f) + c) << 5
+      | (x < y + c) << 4;
+    case FLAGS_INC: // Z 0 H -
+      return ((uint8_t)(x + 1) == 0) << 7 | ((x & 0x0f) == 0x0f) << 5 | c << 4;
+    case FLAGS_DEC: // Z 1 H -
+      return ((uint8_t)(x - 1) == 0) << 7 | 1 << 6 | ((x & 0x0f) == 0) << 5 | c << 4;
+    case FLAGS_XOR: // Z 0 0 0
+      return (x == 0) << 7;
+    case FLAGS_BIT: // Z 0 1 -
+      return (((x >> y) & 1) == 0) << 7 | 1 << 5 | c << 4;
+    case FLAGS_RL: // Z 0 0 C
+      return ((uint8_t)(x << 1 | c) == 0) << 7 | (x >> 7) << 4;
+    case FLAGS_RLA: // 0 0 0 C
+      return (x >> 7) << 4;
+    case FLAGS_RR: // Z 0 0 C
+      return ((x >> 1 | c << 7) == 0) << 7 | (x & 1) << 4;
+    default: // F is up to date
+      return reg.F;
+  }
+}
+
+uint8_t CPU::lazyCarry() {
+  // Work out only the carry flag from the last recorded operation
+  switch (lazy.op) {
+    case FLAGS_ADC:
+      return lazy.x + lazy.y + lazy.carry > 0xff;
+    case FLAGS_SUB:
+      return lazy.x < lazy.y + lazy.carry;
+    case FLAGS_INC:
+    case FLAGS_DEC:
+    case FLAGS_BIT:
+      return lazy.carry;
+    case FLAGS_XOR:
+      return 0;
+    case FLAGS_RL:
+    case FLAGS_RLA:
+      return lazy.x >> 7;
+    case FLAGS_RR:
+      return lazy.x & 1;
+    default: // F is up to date
+      return (reg.F >> 4) & 1;
+  }
+}
+
+uint8_t CPU::getF() {
+  // Bring F up to date if an operation is still recorded
+  if (lazy_flags && lazy.op != FLAGS_NONE) {
+    reg.F = lazyF();
+    lazy.op = FLAGS_NONE;
+  }
+  return reg.F;
+}
+
+uint8_t CPU::getCarry() {
+  if (lazy_flags) {
+    return lazyCarry();
+  }
+  return (reg.F >> 4) & 1;
+}
+
+void CPU::skipBoot(Bus *bus) {
+  //  DMG registers as the boot ROM leaves them, H and C are only set if the
+  // header checksum (0x014d) isn't 0
+  reg.AF = 0x0100;
+  setF(bus->read8(0x014d) == 0 ? 0x80 : 0xb0);
+  reg.BC = 0x0013;
+  reg.DE = 0x00d8;
+  reg.HL = 0x014d;
+  reg.SP = 0xfffe;
+  reg.PC = 0x0100;
+}
+
+void CPU::setF(uint8_t F) {
+  // Overwrite F (lower 4 bits always read as 0) and drop any recorded operation
+  reg.F = F & 0xf0;
+  lazy.op = FLAGS_NONE;
+  check_F = reg.F;
+}
+
+uint8_t &CPU::eagerF() {
+  // F written by eager flag code, a separate copy when checking lazy flags
+  return lazy_flags ? check_F : reg.F;
+}
+
+void CPU::checkFlags() {
+  // Compare lazy F against eager F, exit if they differ
+  if (lazyF() != check_F) {
+    printf("Lazy flags mismatch (op %d x:%02x y:%02x c:%d)\n", lazy.op, lazy.x, lazy.y, lazy.carry);
+    printf("Lazy F:%02x Eager F:%02x\n", lazyF(), check_F);
+    printf("PC:%04x OPCODES RUN: %d\n", reg.PC, opcodes_run);
+    exit(1); // Exit program with error
+  }
+}
+
 // Debug print out
-void CPU::debug(uint8_t A, uint8_t B, uint8_t C, uint8_t D, uint8_t E, uint8_t F, uint8_t H, uint8_t L, uint16_t PC, uint16_t SP, uint32_t opcodes_run, uint32_t total_cycles, uint8_t *mem_map, uint8_t is_cb_opcode) {
-  // For loop that prints mem_map
+void CPU::debug(Bus *bus, uint8_t is_cb_opcode) {
+  // For loop that prints memory
   printf("MEM_MAP:\n");
   for (int i = 0; i < 65536; i++) {
     // Check if first byte, if so, print offset
@@ -1238,7 +1896,7 @@ void CPU::debug(uint8_t A, uint8_t B, uint8_t C, uint8_t D, uint8_t E, uint8_t F
       case 0x00:
         printf("0x%04x ", i);
     }
-    printf("%02x ", mem_map[i]); // Print current hex value
+    printf("%02x ", bus->peek8(i)); // Print current hex value
     // Check if last byte, if so, print line end
     switch (i & 0x0f) { // Bitmask top and check if bottom byte equals 0x0f
       case 0x0f:
@@ -1250,14 +1908,19 @@ void CPU::debug(uint8_t A, uint8_t B, uint8_t C, uint8_t D, uint8_t E, uint8_t F
     case 1:
       printf("From cb\n");
   }
-  printf("Unemulated opcode %02x\n", mem_map[PC]);
-  printf("A:%02x B:%02x C:%02x D:%02x E:%02x F:%02x H:%02x L:%02x\n", A, B, C, D, E, F, H, L);
+  printf("Unemulated opcode %02x\n", bus->peek8(reg.PC));
+  uint8_t F = getF();
+  printf("A:%02x B:%02x C:%02x D:%02x E:%02x F:%02x H:%02x L:%02x\n", reg.A, reg.B, reg.C, reg.D, reg.E, F, reg.H, reg.L);
   printf("Z:%x N:%x H:%x C:%x\n", (F >> 7) & 1, (F >> 6) & 1, (F >> 5) & 1, (F >> 4) & 1);
-  printf("PC:%04x SP:%04x\n", PC, SP); // Print program counter and stack pointer
+  printf("PC:%04x SP:%04x\n", reg.PC, reg.SP); // Print program counter and stack pointer
   printf("OPCODES RUN: %d\n", opcodes_run); // Print total opcodes run
-  printf("TOTAL CYCLES: %d\n", total_cycles); // Print total cycles
+  printf("TOTAL CYCLES: %llu\n", (unsigned long long)total_cycles); // Print total cycles
   exit(1); // Exit program with error
 }
 
 // Delete all CPU related objects
-CPU::~CPU() {}
\ No newline at end of file
+CPU::~CPU() {
+#ifdef GREGGB_JIT
+  delete jit;
+#endif
+}
\ No newline at end of file
@@ -7,68 +7,335 @@ CPU class function signatures
 
 // Include libraries
 #include <cinttypes> // To use uint*_t
+#include <array>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+// Include local header files
+#include "Bus.h"
+
+//  Register pair, the 16-bit view shares storage with its two 8-bit halves, the
+// low register is stored first on little endian hosts so that the pair needs no
+// shifting to read or write
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GREGGB_REGISTER_PAIR(HIGH, LOW) \
+  union { struct { uint8_t HIGH, LOW; }; uint16_t HIGH##LOW; }
+#else
+#define GREGGB_REGISTER_PAIR(HIGH, LOW) \
+  union { struct { uint8_t LOW, HIGH; }; uint16_t HIGH##LOW; }
+#endif
+
+//  Register file, 12 bytes aligned to 16 so it never straddles a cache line,
+// and plain data so CPU state can be copied for snapshots
+struct alignas(16) Registers {
+  // General purpose registers (F is flags register)
+  GREGGB_REGISTER_PAIR(A, F);
+  GREGGB_REGISTER_PAIR(B, C);
+  GREGGB_REGISTER_PAIR(D, E);
+  GREGGB_REGISTER_PAIR(H, L);
+  // Program counter and stack pointer
+  uint16_t SP, PC;
+};
+static_assert(sizeof(Registers) == 16, "Register file must be packed");
+static_assert(std::is_trivially_copyable<Registers>::value, "Register file must be copyable");
+
+//  Build with -DGREGGB_LAZY_FLAGS to work out F only when it is read, add
+// -DGREGGB_LAZY_FLAGS_CHECK to also work it out eagerly and compare the two
+// after every instruction
+#if defined(GREGGB_LAZY_FLAGS_CHECK) && !defined(GREGGB_LAZY_FLAGS)
+#define GREGGB_LAZY_FLAGS
+#endif
+
+//  Build with -DGREGGB_SWITCH_DISPATCH to switch on each opcode instead of
+// indexing the opcode table (to benchmark against), -DGREGGB_THREADED_DISPATCH to
+// jump from each opcode straight to the next (GCC/Clang)
+#if defined(GREGGB_SWITCH_DISPATCH) && defined(GREGGB_THREADED_DISPATCH)
+#error "Pick one of GREGGB_SWITCH_DISPATCH and GREGGB_THREADED_DISPATCH"
+#endif
+
+//  Build with -DGREGGB_JIT to compile hot blocks to x86-64 code (turned on at
+// runtime with CPU::setJit), needs the block cache
+#if defined(GREGGB_JIT) && !(defined(__x86_64__) || defined(_M_X64))
+#error "GREGGB_JIT needs an x86-64 host"
+#endif
+#if defined(GREGGB_JIT) && !defined(GREGGB_BLOCK_CACHE)
+#define GREGGB_BLOCK_CACHE
+#endif
+
+//  Build with -DGREGGB_SUPERINSTRUCTIONS to decode common instruction sequences
+// into one fused handler, needs the block cache
+#if defined(GREGGB_SUPERINSTRUCTIONS) && !defined(GREGGB_BLOCK_CACHE)
+#define GREGGB_BLOCK_CACHE
+#endif
+
+//  Build with -DGREGGB_TRACE_SEQUENCES to count the instruction sequences run
+// inside blocks (printed with CPU::printSequences), to pick superinstructions
+// from, needs the block cache and unfused blocks
+#if defined(GREGGB_TRACE_SEQUENCES) && defined(GREGGB_SUPERINSTRUCTIONS)
+#error "GREGGB_TRACE_SEQUENCES counts unfused instructions, build without GREGGB_SUPERINSTRUCTIONS"
+#endif
+#if defined(GREGGB_TRACE_SEQUENCES) && !defined(GREGGB_BLOCK_CACHE)
+#define GREGGB_BLOCK_CACHE
+#endif
+
+class JIT;
 
 // CPU class
 class CPU {
+  public:
+    //  Opcode handler, executes one instruction and returns cycles (in t-cycles),
+    // n16 is the 2 bytes after the opcode
+    typedef uint8_t (*OpHandler)(CPU &cpu, Bus *bus, uint16_t n16);
+    typedef std::array<OpHandler, 256> OpTable;
+    //  ALU flag tables, F (Z N C) for adc/sbc indexed by the 9 bit result (H comes
+    // from the operands), and Z N H for inc/dec indexed by the operand
+    typedef std::array<uint8_t, 512> CarryFlagTable;
+    typedef std::array<uint8_t, 256> IncFlagTable;
+    // DAA result << 8 | F, indexed by N H C << 8 | A
+    typedef std::array<uint16_t, 2048> DaaTable;
+    //  JIT compiled block, returns cycles (in t-cycles) in the low 32 bits and
+    // instructions run in the high 32 bits
+    typedef uint64_t (*BlockCode)(CPU *cpu, Bus *bus);
+    // Operations lazy flags can record
+    enum FlagOp : uint8_t {
+      FLAGS_NONE, FLAGS_ADC, FLAGS_SUB, FLAGS_INC, FLAGS_DEC, FLAGS_XOR,
+      FLAGS_BIT, FLAGS_RL, FLAGS_RLA, FLAGS_RR
+    };
+    // 8-bit register indexes, in opcode encoding order (R8_HL is memory at HL)
+    enum R8Index : uint8_t {
+      R8_B, R8_C, R8_D, R8_E, R8_H, R8_L, R8_HL, R8_A
+    };
+#ifdef GREGGB_LAZY_FLAGS
+    static constexpr bool lazy_flags = true;
+#else
+    static constexpr bool lazy_flags = false;
+#endif
+#if !defined(GREGGB_LAZY_FLAGS) || defined(GREGGB_LAZY_FLAGS_CHECK)
+    static constexpr bool eager_flags = true;
+#else
+    static constexpr bool eager_flags = false;
+#endif
   private:
-    // General purpose registers
-    uint8_t A,B,C,D,E,F,H,L;
-    // Program counter and stack pointer
-    uint16_t PC,SP;
+    // Registers
+    Registers reg;
+    // Lazy flags, last ALU operation F hasn't been worked out for yet
+    struct {
+      uint8_t op; // FLAGS_*
+      uint8_t x, y; // Operands
+      uint8_t carry; // Carry in (adc, rotates) or carry flag kept (inc, dec, bit)
+    } lazy;
+    uint8_t check_F; // Eager F when checking lazy flags
     // ETC.
     uint32_t opcodes_run;
     uint8_t cycles;
-    uint32_t total_cycles;
-    // PPU ETC. (may or may not keep)
-    //uint16_t ppu_cycles;
-    //uint8_t sprites_scanned;
-    //uint8_t sprites_in_buffer;
-    //uint8_t obj_penalty;
-    //uint8_t wy_is_ly;
+    uint64_t total_cycles; // T-cycles since power on (never reset)
+    uint64_t run_target; // T-cycle the current run stops at
+    //  Idle loops, a backward jr (or HALT) that leaves the registers as the last
+    // one did with no memory written in between ran a pass that changed nothing,
+    // so every pass until something outside the CPU changes memory is the same
+    // and can be skipped. Only passes that read no I/O register other than IF,
+    // STAT, and LY count (see Bus::takePolledIO), those only change at PPU events,
+    // which runs end at, a timer or joypad register could change at any cycle
+    struct {
+      Registers reg; // Registers after the last backward jr
+      uint64_t cycles; // total_cycles then
+      uint32_t opcodes_run; // opcodes_run then
+      bool dirty; // Memory written (or a new run started) since
+    } loop;
+    bool loop_back; // Set by a backward jr or HALT, checked once the instruction is done
+    // Opcode tables (0xcb prefixed opcodes have their own table)
+    static const OpTable op_table;
+    static const OpTable cb_table;
+    // Build opcode tables
+    static constexpr OpTable makeOpTable();
+    static constexpr OpTable makeCBTable();
+    // ALU flag tables (add and cp use carry in 0)
+    static const CarryFlagTable adc_flags;
+    static const CarryFlagTable sbc_flags;
+    static const IncFlagTable inc_flags;
+    static const IncFlagTable dec_flags;
+    static const DaaTable daa_table;
+    // Build ALU flag tables
+    static constexpr CarryFlagTable makeAdcFlags();
+    static constexpr CarryFlagTable makeSbcFlags();
+    static constexpr IncFlagTable makeIncFlags();
+    static constexpr IncFlagTable makeDecFlags();
+    static constexpr DaaTable makeDaaTable();
+    // Opcode table entries for opcodes that aren't emulated yet
+    static uint8_t unemulated(CPU &cpu, Bus *bus, uint16_t n16);
+    static uint8_t unemulatedCB(CPU &cpu, Bus *bus, uint16_t n16);
+    // Most cycles (in t-cycles) any instruction takes
+    static constexpr uint8_t max_op_cycles = 24;
+    // Run until max_instructions have run or the clock reaches target_cycle
+    void run(Bus* bus, uint32_t max_instructions, uint64_t target_cycle);
+    //  Check for an idle loop after loop_back is set, and skip whole passes of it
+    // up to run_target or instructions_left, returns instructions skipped
+    uint32_t skipIdle(Bus *bus, uint32_t instructions_left);
+    // run, while execute watchpoints are set, checking each instruction first
+    void runWatched(Bus* bus, uint32_t max_instructions);
+    //  Block cache (build with -DGREGGB_BLOCK_CACHE), straight line runs of
+    // instructions decoded once and then run from their decoded form
+    struct Instruction {
+      OpHandler handler; // Handler (0xcb opcodes resolved to their cb_table entry)
+      uint16_t n16; // Operand bytes
+      uint8_t length; // Length in bytes
+      uint8_t ops; // Instructions it runs (more than 1 if fused)
+      uint16_t cycles_before; // T-cycles the entries before it in its block take
+      uint8_t cycles; // T-cycles it takes if it doesn't branch
+      bool writes; // Can write memory (and so flush the block cache)
+    };
+    struct Block {
+      uint32_t first; // Index of first instruction in block_insts
+      uint16_t count; // Number of entries in block_insts
+      uint16_t ops; // Number of instructions (fused entries run more than 1)
+      uint16_t runs; // Times run by the interpreter (JIT compiles hot blocks)
+      uint16_t cycles; // T-cycles it takes if its last instruction doesn't branch
+      BlockCode code; // JIT compiled code (nullptr if not compiled)
+    };
+    static const uint8_t op_length[256];
+    static const uint8_t op_cycles[256];
+    static uint8_t opCycles(uint8_t opcode, uint8_t cb_opcode);
+    static constexpr bool writesMemory(uint8_t opcode, uint8_t cb_opcode);
+    static constexpr uint16_t max_block_length = 32;
+    std::vector<uint16_t> block_index; // Index of block starting at each address (0 = none)
+    //  Blocks starting in 0x4000-0x7fff are indexed per ROM bank (keyed by the
+    // bank's host memory), so code that switches banks back and forth keeps the
+    // blocks of every bank it has run from
+    std::unordered_map<const uint8_t*, std::vector<uint16_t>> bank_index;
+    const uint8_t* high_bank; // Bank mapped at 0x4000-0x7fff when last checked
+    uint16_t* high_index; // Its bank_index entry (nullptr if it has no blocks yet)
+    std::vector<Block> blocks;
+    std::vector<Instruction> block_insts;
+    //  1 bit per address from 0x8000 up, set if it is in a cached block (ROM can't
+    // be written, so code there never needs flushing)
+    std::vector<uint8_t> code_bits;
+    bool blocks_flushed; // Set when blocks are thrown away while one is running
+    static bool endsBlock(uint8_t opcode);
+    uint16_t findBlock(uint16_t pc);
+    uint16_t buildBlock(Bus *bus);
+    uint16_t runBlock(uint16_t index, Bus *bus);
+    void flushBlocks();
+    void dropRegions(Bus *bus, uint8_t regions);
+    //  Superinstructions (build with -DGREGGB_SUPERINSTRUCTIONS), sequences that
+    // are decoded into one entry whose handler runs every instruction in it
+    struct Fusion {
+      uint16_t keys[3]; // Opcodes in order (0xcbxx for 0xcb prefixed ones)
+      uint8_t ops; // Number of opcodes in keys
+      OpHandler handler;
+    };
+    static const Fusion fusions[];
+    template <uint16_t... keys>
+    static uint8_t fused(CPU &cpu, Bus *bus, uint16_t n16);
+    template <uint16_t key, uint16_t... rest>
+    uint8_t fusedStep(Bus *bus, uint16_t operands, uint64_t clock);
+    bool fuseInstruction(uint16_t pc, Bus *bus, Instruction &inst, uint8_t &last_opcode);
+    //  Sequence tracing (build with -DGREGGB_TRACE_SEQUENCES), counts of the pairs
+    // and triples run back to back in a block, keyed by length << 48 and the
+    // opcodes 16 bits each (0xcbxx for 0xcb prefixed ones)
+    std::vector<uint16_t> block_keys; // Opcode of each block_insts entry
+    std::unordered_map<uint64_t, uint64_t> sequence_counts;
+    void countSequences(uint32_t first, uint32_t i);
+    //  JIT (build with -DGREGGB_JIT), blocks are compiled once they have run
+    // jit_threshold times, lockstep runs each compiled block and the interpreter
+    // from the same state and stops if they don't match
+    friend class JIT;
+    static constexpr uint16_t jit_threshold = 16;
+    static constexpr uint16_t jit_never = 0xffff; // Block runs if it can't be compiled
+    JIT* jit;
+    bool jit_enabled;
+    bool jit_lockstep;
+    bool jitSuitable(uint16_t pc, uint16_t count, Bus *bus);
+    uint16_t runJitBlock(uint16_t index, Bus *bus);
+    uint16_t runLockstep(uint16_t index, Bus *bus);
   public:
     // Create CPU object
     CPU();
     // CPU loop
-    void cpuLoop(uint8_t* mem_map, uint32_t cycles_to_run);
+    void cpuLoop(Bus* bus, uint32_t instructions_to_run);
+    //  Run until the T-cycle clock reaches target_cycle (e.g. getCycles() + 70224
+    // for a frame), or the next scheduled event
+    void runUntil(Bus* bus, uint64_t target_cycle);
+    uint64_t getCycles();
+    //  Stop the current run once the clock reaches cycle instead, if that is
+    // sooner (for events scheduled by what the running code does)
+    void stopAt(uint64_t cycle);
+    // Turn JIT on or off (lockstep checks it against the interpreter)
+    void setJit(bool enabled, bool lockstep);
+    //  Print the top most run pairs and triples of instructions (build with
+    // -DGREGGB_TRACE_SEQUENCES, and run without the JIT)
+    void printSequences(size_t top);
+    //  ALU flags (F as Z N H C) for adc/sbc of x, y, and carry in c (add and cp
+    // use c = 0), Z N H for inc/dec of x (the caller keeps C), and DAA's
+    // result << 8 | F for A and F
+    static uint8_t adcFlags(uint8_t x, uint8_t y, uint8_t c);
+    static uint8_t sbcFlags(uint8_t x, uint8_t y, uint8_t c);
+    static uint8_t incFlags(uint8_t x);
+    static uint8_t decFlags(uint8_t x);
+    static uint16_t daaResult(uint8_t A, uint8_t F);
+    // Start at 0x0100 with registers as the boot ROM leaves them
+    void skipBoot(Bus *bus);
+    // Fetch, decode, and execute one instruction
+    void step(Bus *bus);
+    const uint8_t* fetchCode(Bus *bus, uint8_t *slow_code);
+    uint16_t fetchOperand(Bus *bus);
+    //  Write to memory (with the block cache, flushes cached blocks the write lands
+    // in or switches out)
+    void write8(Bus *bus, uint16_t addr, uint8_t val);
+    void writeHigh(Bus *bus, uint8_t index, uint8_t val);
+    uint16_t codeAddr(uint16_t addr);
     // Instruction functions
     // r8/r16 is any 8-bit/16-bit register
     // n8/n16 is a 8-bit/16-bit int constant
     // e8 is a 8-bit offset from -127 to 128
     // u3 is a 3-bit unsigned int constant
-    uint8_t adc_a_r8(uint8_t *A, uint8_t *r8, uint8_t *F, uint16_t *PC);
-    uint8_t bit_u3_r8(uint8_t u3, uint8_t r8, uint8_t *F, uint16_t *PC);
-    uint8_t call_cc_n16(int16_t n16, uint8_t F, uint8_t cc, uint16_t *SP, uint16_t *PC, uint8_t *mem_map);
-    uint8_t cp_A_n8_OR_r8(uint8_t A, uint8_t n8_OR_r8, uint8_t *F, uint16_t *PC, uint8_t is_n8);
-    uint8_t dec_r8(uint8_t *r8, uint8_t *F, uint16_t *PC);
-    uint8_t inc_HL(uint8_t *HL, uint8_t *F, uint16_t *PC, uint8_t mem_map);
-    uint8_t inc_r16(uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC);
-    uint8_t inc_r8(uint8_t *r8, uint8_t *F, uint16_t *PC);
-    uint8_t inc_SP(uint16_t *SP, uint16_t *PC);
-    uint8_t ld_A_ff00_C(uint8_t *A, uint8_t C, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_A_ff00_n8(uint8_t *A, uint8_t n8, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_ff00_C_A(uint8_t A, uint8_t C, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_ff00_n8_A(uint8_t A, uint8_t n8, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_HLID_r8(uint8_t r8, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC, uint8_t *mem_map, uint8_t is_increment);
-    uint8_t ld_n16_r8(uint8_t r8, uint16_t n16, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_r16_r8(uint8_t r8, uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_r8_HLID(uint8_t *r8, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC, uint8_t *mem_map, uint8_t is_increment);
-    uint8_t ld_r8_r16(uint8_t *r8, uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_r8_dest_r8_src(uint8_t r8_src, uint8_t *r8_dest, uint16_t *PC);
-    uint8_t ld_r16_n16(uint16_t n16, uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *PC);
-    uint8_t ld_r8_n8(uint8_t n8, uint8_t *r8, uint16_t *PC);
-    uint8_t ld_r16_A(uint8_t *A, uint16_t r16, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ld_SP_n16(uint16_t n16, uint16_t *SP, uint16_t *PC);
-    uint8_t pop_r16(uint8_t *r8_HIGH, uint8_t *r8_LOW, uint16_t *SP, uint16_t *PC, uint8_t *mem_map);
-    uint8_t push_r16(uint8_t r8_HIGH, uint8_t r8_LOW, uint16_t *SP, uint16_t *PC, uint8_t *mem_map);
-    uint8_t jr_cc_i8(int8_t i8, uint8_t F, uint8_t cc, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ret(uint16_t *SP, uint16_t *PC, uint8_t *mem_map);
-    uint8_t ret_cc(uint8_t F, uint8_t cc, uint16_t *SP, uint16_t *PC, uint8_t *mem_map);
-    uint8_t rlca(uint8_t *A, uint8_t *F, uint16_t *PC);
-    uint8_t rl_r8(uint8_t *r8, uint8_t *F, uint16_t *PC);
-    uint8_t rr_r8(uint8_t *r8, uint8_t *F, uint16_t *PC);
-    uint8_t xor_a_r8(uint8_t *A, uint8_t *r8, uint8_t *F, uint16_t *PC);
+    //  cc (0=NZ, 1=NC, 2=Z, 3=C, 4=none), bit indexes, register indexes, and
+    // other per opcode selectors are template arguments, so every opcode gets
+    // its own copy with no selector checks left in it
+    template <uint8_t cc> bool condition();
+    template <uint8_t r8_index> uint8_t &reg8();
+    uint8_t adc_a_r8(uint8_t r8);
+    template <uint8_t u3, uint8_t r8_index> uint8_t bit_u3_r8();
+    template <uint8_t cc> uint8_t call_cc_n16(uint16_t n16, Bus *bus);
+    template <bool is_n8> uint8_t cp_A_n8_OR_r8(uint8_t n8_OR_r8);
+    uint8_t daa();
+    uint8_t dec_r8(uint8_t *r8);
+    uint8_t halt(Bus *bus);
+    uint8_t inc_HL(Bus *bus);
+    uint8_t inc_r16(uint16_t *r16);
+    uint8_t inc_r8(uint8_t *r8);
+    uint8_t ld_A_ff00_C(Bus *bus);
+    uint8_t ld_A_ff00_n8(uint8_t n8, Bus *bus);
+    uint8_t ld_ff00_C_A(Bus *bus);
+    uint8_t ld_ff00_n8_A(uint8_t n8, Bus *bus);
+    template <bool is_increment> uint8_t ld_HLID_r8(uint8_t r8, Bus *bus);
+    uint8_t ld_n16_r8(uint8_t r8, uint16_t n16, Bus *bus);
+    uint8_t ld_r16_r8(uint8_t r8, uint16_t r16, Bus *bus);
+    template <bool is_increment> uint8_t ld_r8_HLID(uint8_t *r8, Bus *bus);
+    uint8_t ld_r8_r16(uint8_t *r8, uint16_t r16, Bus *bus);
+    uint8_t ld_r8_dest_r8_src(uint8_t r8_src, uint8_t *r8_dest);
+    uint8_t ld_r16_n16(uint16_t n16, uint16_t *r16);
+    uint8_t ld_r8_n8(uint8_t n8, uint8_t *r8);
+    uint8_t ld_r16_A(uint16_t r16, Bus *bus);
+    uint8_t pop_r16(uint16_t *r16, Bus *bus);
+    uint8_t push_r16(uint16_t r16, Bus *bus);
+    template <uint8_t cc> uint8_t jr_cc_i8(int8_t i8);
+    uint8_t ret(Bus *bus);
+    template <uint8_t cc> uint8_t ret_cc(Bus *bus);
+    uint8_t rlca();
+    uint8_t rl_r8(uint8_t *r8);
+    uint8_t rr_r8(uint8_t *r8);
+    uint8_t xor_a_r8(uint8_t r8);
+    // Lazy flags
+    void deferFlags(uint8_t op, uint8_t x, uint8_t y, uint8_t carry);
+    uint8_t lazyF();
+    uint8_t lazyCarry();
+    uint8_t getF();
+    uint8_t getCarry();
+    void setF(uint8_t F);
+    uint8_t &eagerF();
+    void checkFlags();
     // Debug print out
-    void debug(uint8_t A, uint8_t B, uint8_t C, uint8_t D, uint8_t E, uint8_t F, uint8_t H, uint8_t L, uint16_t PC, uint16_t SP, uint32_t opcodes_run, uint32_t total_cycles, uint8_t *mem_map, uint8_t is_cb_opcode);
+    void debug(Bus *bus, uint8_t is_cb_opcode);
     // Delete all CPU related objects
     ~CPU();
 };
@@ -0,0 +1,166 @@
+/*
+Cartridge class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// Include local header files
+#include "Cartridge.h"
+
+std::vector<Cartridge*> Cartridge::loaded;
+std::mutex Cartridge::loaded_lock;
+
+// Create Cartridge object
+Cartridge::Cartridge(const char *path) {
+  rom = nullptr;
+  rom_size = 0;
+  map_size = 0;
+  memset(&key, 0, sizeof(key));
+  users = 0;
+#if defined(_WIN32)
+  map_handle = nullptr;
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  LARGE_INTEGER file_size;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    printf("Error: Could not open ROM %s\n", path);
+    exit(1);
+  }
+  size_t size = file_size.QuadPart;
+  BY_HANDLE_FILE_INFORMATION info;
+  if (GetFileInformationByHandle(file, &info)) {
+    key.device = info.dwVolumeSerialNumber;
+    key.file_number = (uint64_t)info.nFileIndexHigh << 32 | info.nFileIndexLow;
+    key.modified = (int64_t)info.ftLastWriteTime.dwHighDateTime << 32 | info.ftLastWriteTime.dwLowDateTime;
+  }
+  map_handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  const uint8_t *map = map_handle != nullptr ? (const uint8_t*)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  CloseHandle(file); // The mapping keeps the file open
+#else
+  int file = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (file < 0 || fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+    printf("Error: Could not open ROM %s\n", path);
+    exit(1);
+  }
+  size_t size = file_stat.st_size;
+  key.device = file_stat.st_dev;
+  key.file_number = file_stat.st_ino;
+  key.modified = file_stat.st_mtime;
+  const uint8_t *map = (const uint8_t*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  if (map == MAP_FAILED) {
+    map = nullptr;
+  }
+  close(file); // The mapping keeps the file open
+#endif
+  if (map == nullptr) {
+    printf("Error: Could not map ROM %s\n", path);
+    exit(1);
+  }
+  if (size >= 0x8000 && size % 0x4000 == 0) {
+    // Use the mapping as is, banks are read straight out of it
+    rom = map;
+    rom_size = size;
+    map_size = size;
+  } else {
+    //  Copy into whole 16KB banks (at least 2) padded with 0xff (open bus), then
+    // let the mapping go
+    rom_size = paddedSize(size);
+    uint8_t *copy = new uint8_t[rom_size];
+    memset(copy, 0xff, rom_size);
+    memcpy(copy, map, size);
+    rom = copy;
+#if defined(_WIN32)
+    UnmapViewOfFile(map);
+    CloseHandle(map_handle);
+    map_handle = nullptr;
+#else
+    munmap((void*)map, size);
+#endif
+  }
+  // Only the header's pages are touched (rom is at least 32KB, so it has one)
+  key.file_size = size;
+  key.header_checksum = rom[0x14d];
+  key.global_checksum = rom[0x14e] << 8 | rom[0x14f];
+}
+
+// Load the ROM file at path, sharing it if it is already loaded
+Cartridge* Cartridge::load(const char *path) {
+  Cartridge *cart = new Cartridge(path);
+  std::lock_guard<std::mutex> lock(loaded_lock);
+  for (Cartridge *other : loaded) {
+    const Key &a = other->key, &b = cart->key;
+    if (a.file_size == b.file_size && a.header_checksum == b.header_checksum
+    && a.global_checksum == b.global_checksum && a.device == b.device
+    && a.file_number == b.file_number && a.modified == b.modified) {
+      // Same ROM, let go of this copy and share the loaded one
+      delete cart;
+      other->users++;
+      return other;
+    }
+  }
+  cart->users = 1;
+  loaded.push_back(cart);
+  return cart;
+}
+
+// Release a Cartridge from load, deleting it after its last user
+void Cartridge::release(Cartridge *cart) {
+  std::lock_guard<std::mutex> lock(loaded_lock);
+  cart->users--;
+  if (cart->users > 0) {
+    return;
+  }
+  for (size_t i = 0; i < loaded.size(); i++) {
+    if (loaded[i] == cart) {
+      loaded.erase(loaded.begin() + i);
+      break;
+    }
+  }
+  delete cart;
+}
+
+const uint8_t* Cartridge::getROM() {
+  return rom;
+}
+
+size_t Cartridge::getSize() {
+  return rom_size;
+}
+
+size_t Cartridge::paddedSize(size_t file_size) {
+  return file_size < 0x8000 ? 0x8000 : (file_size + 0x3fff) & ~(size_t)0x3fff;
+}
+
+uint64_t Cartridge::hashROM(const uint8_t *rom, size_t rom_size) {
+  // Hash the whole ROM, different ROMs often have the same header checksums
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < rom_size; i++) {
+    hash = (hash ^ rom[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Delete all Cartridge related objects
+Cartridge::~Cartridge() {
+  if (map_size == 0) {
+    delete[] rom;
+    return;
+  }
+#if defined(_WIN32)
+  UnmapViewOfFile(rom);
+  CloseHandle(map_handle);
+#else
+  munmap((void*)rom, map_size);
+#endif
+}
@@ -0,0 +1,63 @@
+/*
+Cartridge class function signatures
+*/
+
+#ifndef CARTRIDGE_H
+#define CARTRIDGE_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+//  Cartridge ROM, mapped read only straight from the file so loading costs the
+// same for any size of ROM and the OS shares the bytes between processes. ROMs
+// under 32KB or not a whole number of 16KB banks are copied into a padded buffer
+// instead, so every bank can be read without going past the end of the file.
+//  Cartridges are shared, every GB object loading the same ROM file gets the
+// same read only image
+class Cartridge {
+  private:
+    //  What a loaded ROM is found by, without reading more than its header: the
+    // file's size and header and global checksums, and which file it is (ROM hacks
+    // often keep the checksums of the ROM they came from), device and file number
+    // and when it was last written, so a file rewritten in place isn't shared
+    struct Key {
+      uint64_t file_size;
+      uint8_t header_checksum; // 0x014d
+      uint16_t global_checksum; // 0x014e-0x014f
+      uint64_t device; // Device (volume serial number on Windows)
+      uint64_t file_number; // Inode (file index on Windows)
+      int64_t modified; // Modification time (last write time on Windows)
+    };
+    const uint8_t* rom; // ROM bytes
+    size_t rom_size; // Size in bytes (whole 16KB banks, at least 2)
+    size_t map_size; // Size of the file mapping (0 if rom is a copy)
+#if defined(_WIN32)
+    void* map_handle; // File mapping handle
+#endif
+    Key key;
+    uint32_t users; // Number of load calls not yet released
+    // Every loaded Cartridge, and the lock for it and users
+    static std::vector<Cartridge*> loaded;
+    static std::mutex loaded_lock;
+    // Create Cartridge object from the ROM file at path
+    Cartridge(const char *path);
+    // Delete all Cartridge related objects
+    ~Cartridge();
+  public:
+    //  Load the ROM file at path, or share the Cartridge already loaded with the
+    // same ROM, and release it once done with it
+    static Cartridge* load(const char *path);
+    static void release(Cartridge *cart);
+    const uint8_t* getROM();
+    size_t getSize();
+    //  Size a ROM file of file_size bytes is padded to (whole 16KB banks, at
+    // least 2), and an FNV-1a hash of a whole ROM (for ROMLibrary, loading doesn't
+    // hash)
+    static size_t paddedSize(size_t file_size);
+    static uint64_t hashROM(const uint8_t *rom, size_t rom_size);
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+CartridgeHeader class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstring>
+#include <string>
+// Include local header files
+#include "CartridgeHeader.h"
+#include "MBC.h"
+
+// Create CartridgeHeader object from a ROM
+CartridgeHeader::CartridgeHeader(const uint8_t *rom, size_t rom_size) {
+  valid = rom_size >= header_start + header_size;
+  memset(bytes, 0, sizeof(bytes));
+  global_checksum_valid = false;
+  if (!valid) {
+    return;
+  }
+  memcpy(bytes, rom + header_start, header_size);
+}
+
+// Create CartridgeHeader object from saved header bytes
+CartridgeHeader::CartridgeHeader(const uint8_t *header_bytes, bool global_checksum_valid) {
+  valid = true;
+  memcpy(bytes, header_bytes, header_size);
+  this->global_checksum_valid = global_checksum_valid;
+}
+
+const uint8_t* CartridgeHeader::getBytes() {
+  return bytes;
+}
+
+bool CartridgeHeader::isValid() {
+  return valid;
+}
+
+std::string CartridgeHeader::getTitle() {
+  // 0x0134-0x0143, padded with 0s, anything unprintable is left out
+  std::string title;
+  uint32_t length = getCGBFlag() & 0x80 ? 15 : 16;
+  for (uint32_t i = 0; i < length; i++) {
+    uint8_t c = bytes[0x134 - header_start + i];
+    if (c == 0) {
+      break;
+    }
+    if (c >= 0x20 && c < 0x7f) {
+      title.push_back(c);
+    }
+  }
+  return title;
+}
+
+uint8_t CartridgeHeader::getCGBFlag() {
+  return bytes[0x143 - header_start];
+}
+
+bool CartridgeHeader::isCGBOnly() {
+  return getCGBFlag() == 0xc0;
+}
+
+uint8_t CartridgeHeader::getCartridgeType() {
+  return bytes[0x147 - header_start];
+}
+
+bool CartridgeHeader::isSupported() {
+  MBC::Type type;
+  return valid && MBC::lookupType(getCartridgeType(), type);
+}
+
+const char* CartridgeHeader::getMBCName() {
+  MBC::Type type;
+  if (!MBC::lookupType(getCartridgeType(), type)) {
+    return "Unsupported";
+  }
+  return MBC::typeName(type);
+}
+
+bool CartridgeHeader::hasBattery() {
+  return MBC::hasBattery(getCartridgeType());
+}
+
+uint32_t CartridgeHeader::getROMSize() {
+  // 32KB doubled for each step
+  uint8_t code = bytes[0x148 - header_start];
+  return code <= 8 ? 0x8000 << code : 0;
+}
+
+uint32_t CartridgeHeader::getRAMSize() {
+  // MBC2 has 512 half bytes built in, whatever the RAM size byte says
+  static const uint32_t ram_sizes[6] = {0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000};
+  MBC::Type type;
+  if (MBC::lookupType(getCartridgeType(), type) && type == MBC::MBC2) {
+    return 512;
+  }
+  uint8_t code = bytes[0x149 - header_start];
+  return code < 6 ? ram_sizes[code] : 0;
+}
+
+uint8_t CartridgeHeader::getHeaderChecksum() {
+  return bytes[0x14d - header_start];
+}
+
+bool CartridgeHeader::headerChecksumValid() {
+  // Worked out over 0x0134-0x014c the same way the boot ROM does
+  uint8_t sum = 0;
+  for (uint32_t addr = 0x134; addr <= 0x14c; addr++) {
+    sum = sum - bytes[addr - header_start] - 1;
+  }
+  return valid && sum == getHeaderChecksum();
+}
+
+uint16_t CartridgeHeader::getGlobalChecksum() {
+  // Stored big endian, unlike everything else on the Game Boy
+  return (bytes[0x14e - header_start] << 8) | bytes[0x14f - header_start];
+}
+
+bool CartridgeHeader::checkGlobalChecksum(const uint8_t *rom, size_t file_size) {
+  // Global checksum, every byte of the ROM added up except the checksum's own
+  if (!valid || file_size < header_start + header_size) {
+    global_checksum_valid = false;
+    return false;
+  }
+  uint16_t sum = 0;
+  for (size_t i = 0; i < file_size; i++) {
+    sum = sum + rom[i];
+  }
+  sum = sum - rom[0x14e] - rom[0x14f];
+  global_checksum_valid = sum == getGlobalChecksum();
+  return global_checksum_valid;
+}
+
+bool CartridgeHeader::globalChecksumValid() {
+  return global_checksum_valid;
+}
@@ -0,0 +1,59 @@
+/*
+CartridgeHeader class function signatures
+*/
+
+#ifndef CARTRIDGEHEADER_H
+#define CARTRIDGEHEADER_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstddef>
+#include <string>
+
+//  Cartridge header (0x0100-0x014f), kept as its raw bytes and decoded when
+// asked, so it can be stored and read back as is. Never exits on a bad ROM,
+// anything that doesn't check out is reported for the caller to decide on
+class CartridgeHeader {
+  public:
+    static constexpr uint32_t header_start = 0x100;
+    static constexpr uint32_t header_size = 0x50;
+  private:
+    uint8_t bytes[header_size];
+    bool valid; // ROM was long enough to have a header
+    bool global_checksum_valid; // Set by checkGlobalChecksum (false until then)
+  public:
+    //  Create CartridgeHeader object from a ROM (rom_size bytes), only the header
+    // is read, the global checksum isn't checked until checkGlobalChecksum
+    CartridgeHeader(const uint8_t *rom, size_t rom_size);
+    //  Create CartridgeHeader object from header bytes saved with getBytes (and
+    // whether the global checksum matched)
+    CartridgeHeader(const uint8_t *header_bytes, bool global_checksum_valid);
+    // Header bytes (header_size of them, from header_start)
+    const uint8_t* getBytes();
+    bool isValid();
+    // Title, up to 16 characters (15 on CGB cartridges, whose last is the CGB flag)
+    std::string getTitle();
+    // CGB flag (0x80 also works on CGB, 0xc0 only works on CGB)
+    uint8_t getCGBFlag();
+    bool isCGBOnly();
+    //  Cartridge type byte, whether its MBC is emulated, and its MBC's name
+    // ("Unsupported" if it isn't)
+    uint8_t getCartridgeType();
+    bool isSupported();
+    const char* getMBCName();
+    bool hasBattery();
+    // ROM and external RAM size in bytes, as the header says (0 if it is unknown)
+    uint32_t getROMSize();
+    uint32_t getRAMSize();
+    //  Checksums as stored, and whether they match the header and ROM (a real
+    // Game Boy won't start a cartridge whose header checksum doesn't match)
+    uint8_t getHeaderChecksum();
+    bool headerChecksumValid();
+    uint16_t getGlobalChecksum();
+    //  Add up the whole ROM to check the global checksum (file_size bytes, as in
+    // the file, not padded), only done when asked as it reads every byte
+    bool checkGlobalChecksum(const uint8_t *rom, size_t file_size);
+    bool globalChecksumValid();
+};
+
+#endif
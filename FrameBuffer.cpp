@@ -0,0 +1,51 @@
+/*
+FrameBuffer class function definitions
+*/
+
+// Include libraries
+#include <atomic>
+#include <cinttypes> // To use uint*_t
+#include <cstring>
+// Include local header files
+#include "FrameBuffer.h"
+
+// Create FrameBuffer object
+FrameBuffer::FrameBuffer() {
+  memset(buffers, 0, sizeof(buffers));
+  back = 0;
+  middle.store(1, std::memory_order_relaxed);
+  front = 2;
+}
+
+void FrameBuffer::publish() {
+  //  Swap the finished frame into the middle, marked fresh, and draw the next
+  // one into whichever buffer was there (the consumer never holds it)
+  back = middle.exchange(back | fresh, std::memory_order_acq_rel) & 0x03;
+}
+
+bool FrameBuffer::acquire() {
+  // Only swap with the middle if it holds a frame newer than the front one
+  if (!(middle.load(std::memory_order_relaxed) & fresh)) {
+    return false;
+  }
+  front = middle.exchange(front, std::memory_order_acq_rel) & 0x03;
+  return true;
+}
+
+const uint8_t* FrameBuffer::getFront() {
+  return buffers[front];
+}
+
+// Shades of the original Game Boy's green LCD
+const uint8_t FrameBuffer::dmg_palette[4][4] = {
+  {0x9b, 0xbc, 0x0f, 0xff}, {0x8b, 0xac, 0x0f, 0xff}, {0x30, 0x62, 0x30, 0xff}, {0x0f, 0x38, 0x0f, 0xff}
+};
+
+void FrameBuffer::toRGBA(const uint8_t *frame, uint8_t *rgba, const uint8_t (*palette)[4]) {
+  if (palette == nullptr) {
+    palette = dmg_palette;
+  }
+  for (uint32_t i = 0; i < width * height; i++) {
+    memcpy(rgba + i * 4, palette[frame[i] & 0x03], 4);
+  }
+}
@@ -0,0 +1,51 @@
+/*
+FrameBuffer class function signatures
+*/
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+// Include libraries
+#include <atomic>
+#include <cinttypes> // To use uint*_t
+
+//  Frames the PPU draws, one byte per pixel holding its palette index (shade 0
+// white to 3 black), so a frame is 23KB and only a consumer that shows or
+// records it converts it to RGBA. Finished frames are handed over through a
+// lock-free triple buffer: the PPU draws into one buffer, the consumer (a
+// renderer or recorder thread) reads another, and the third holds the newest
+// finished frame, swapped in and out with one atomic exchange, so neither side
+// ever waits for the other
+class FrameBuffer {
+  public:
+    static constexpr uint32_t width = 160;
+    static constexpr uint32_t height = 144;
+  private:
+    uint8_t buffers[3][width * height];
+    uint8_t back; // Buffer being drawn (emulation thread only)
+    uint8_t front; // Buffer being read (consumer thread only)
+    //  Buffer in between, with fresh set if it was published since the consumer
+    // last took it
+    static constexpr uint8_t fresh = 0x04;
+    alignas(64) std::atomic<uint8_t> middle;
+  public:
+    // Create FrameBuffer object, every buffer blank
+    FrameBuffer();
+    // Buffer to draw the next frame into (changes on each publish)
+    uint8_t* getBack() {
+      return buffers[back];
+    }
+    // Hand the frame drawn into the back buffer over as the newest one
+    void publish();
+    //  Take the newest published frame as the front buffer, returns false (keeping
+    // the front buffer as it was) if none was published since the last call
+    bool acquire();
+    // Frame taken by the last acquire (blank before the first)
+    const uint8_t* getFront();
+    //  Convert a frame's palette indexes to RGBA bytes (4 per pixel), through
+    // palette (RGBA for each shade, dmg_palette if nullptr)
+    static void toRGBA(const uint8_t *frame, uint8_t *rgba, const uint8_t (*palette)[4] = nullptr);
+    static const uint8_t dmg_palette[4][4];
+};
+
+#endif
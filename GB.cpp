@@ -4,54 +4,152 @@ GB class function definitions
 
 // Include libraries
 //#include <SFML/Graphics.hpp>
+#include <algorithm>
 #include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 // Include local header files
 #include "GB.h"
+#include "Bus.h"
+#include "Cartridge.h"
+#include "CartridgeHeader.h"
 #include "CPU.h"
-//#include "PPU.h"
+#include "MBC.h"
+#include "PPU.h"
+#include "SaveFile.h"
 
 // Create GB object
-GB::GB() {
-  // Initialize memory map
-  mem_map = new uint8_t[65536];
-  mem_map[0] = 0;
-
-  // Reading Boot ROM into memory
-  FILE *rom_ptr = 0;
-  // Open the file (remember to open as bytes "rb")
-  rom_ptr = fopen("C:/Users/BellwetherWealth-Enq/Games/ROMs/GB/[BIOS] Nintendo Game Boy Boot ROM (World) (Rev 1).gb", "rb");
-  // File ptr, offset, where offset added (SEEK_SET, SEEK_CUR, SEEK_END)
-  fseek(rom_ptr, 0, SEEK_SET); // Set place in file to read from
-  // Memory ptr, size of each element (in bytes), number of elements, file ptr
-  fread(mem_map, 1, 256, rom_ptr); // Reads Boot ROM into start of mem_map
-  fclose(rom_ptr); // Close to prevent issues
-  
-  //  Reading cartridge into memory (first 32kb minus first 256b that Boot ROM
-  // is in, will overwrite after boot process)
-  rom_ptr = 0;
-  // Open the file (remember to open as bytes "rb")
-  rom_ptr = fopen("C:/Users/BellwetherWealth-Enq/Games/ROMs/GB/Dr. Mario (World).gb", "rb");
-  // File ptr, offset, where offset added (SEEK_SET, SEEK_CUR, SEEK_END)
-  fseek(rom_ptr, 0x100, SEEK_SET); // Set place in file to read from
-  // Memory ptr, size of each element (in bytes), number of elements, file ptr
-  fread(mem_map + 0x100, 1, 32512, rom_ptr); // Reads ROM into after Boot ROM
-  fclose(rom_ptr); // Close to prevent issues
+GB::GB(const char *boot_path, const char *rom_path, int ppu_accuracy) {
+  // Initialize memory bus
+  bus = new Bus;
+
+  //  Reading Boot ROM into its overlay, which covers the cartridge's first 256
+  // bytes until the boot ROM turns it off (no Boot ROM skips straight to 0x0100)
+  if (boot_path != nullptr) {
+    FILE *rom_ptr = 0;
+    // Open the file (remember to open as bytes "rb")
+    rom_ptr = fopen(boot_path, "rb");
+    if (rom_ptr == 0) {
+      printf("Error: Could not open Boot ROM %s\n", boot_path);
+      exit(1);
+    }
+    // Memory ptr, size of each element (in bytes), number of elements, file ptr
+    fread(bus->getBootROM(), 1, 256, rom_ptr); // Reads Boot ROM into overlay
+    fclose(rom_ptr); // Close to prevent issues
+  }
+
+  //  Map cartridge ROM (no copy, banks are read straight from the file, and
+  // shared with other GB objects running the same ROM)
+  cart = Cartridge::load(rom_path);
+  // Only the header is read, the global checksum isn't needed to run the ROM
+  CartridgeHeader header(cart->getROM(), cart->getSize());
+  if (!header.isSupported()) {
+    printf("Error: %s is a %02x cartridge (%s), which is not emulated\n", rom_path, header.getCartridgeType(), header.getMBCName());
+    exit(1);
+  }
+  // A real Game Boy locks up on a bad header checksum, run it anyway but say so
+  if (!header.headerChecksumValid()) {
+    printf("Warning: %s has a bad header checksum\n", rom_path);
+  }
+  if (header.isCGBOnly()) {
+    printf("Warning: %s only runs on a Game Boy Color\n", rom_path);
+  }
+  bus->mapROM(cart->getROM(), cart->getSize());
+
+  //  Battery backed RAM is loaded from the .sav file next to the ROM (created if
+  // there isn't one), and written back to it as the game changes it
+  save = nullptr;
+  MBC *mbc = bus->getMBC();
+  if (header.hasBattery() && mbc->getRAMSize() > 0) {
+    std::string save_path = rom_path;
+    size_t dot = save_path.find_last_of('.');
+    size_t slash = save_path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+      save_path.erase(dot);
+    }
+    save_path = save_path + ".sav";
+    save = new SaveFile(save_path.c_str(), mbc->getRAMSize());
+    memcpy(mbc->getRAM(), save->getData(), mbc->getRAMSize());
+  }
 
   // Create CPU
   cpu = new CPU;
+  frame_end = 0;
+  screen_rgba.resize(FrameBuffer::width * FrameBuffer::height * 4);
+  if (boot_path == nullptr) {
+    bus->skipBoot();
+    cpu->skipBoot(bus);
+  }
+  //  Create PPU, which gets LCD register writes from the bus, drawing with the
+  // pixel FIFO if asked to or if the ROM is known to need it
+  if (ppu_accuracy == -1) {
+    ppu_accuracy = PPU::accuracyFor(header);
+  }
+  ppu = new PPU(*bus, *cpu, (PPU::Accuracy)ppu_accuracy);
+  bus->setPPU(ppu);
+}
+
+// Turn CPU JIT on or off
+void GB::setJit(bool enabled, bool lockstep) {
+  cpu->setJit(enabled, lockstep);
 }
 
 // Emulator loop
 void GB::emuLoop() {
-  // Run CPU for 1000000 cycles (testing)
-  cpu->cpuLoop(mem_map, 1000000);
+  // Run CPU for 60 frames (testing)
+  for (int i = 0; i < 60; i++) {
+    runFrame();
+    renderScreen();
+  }
+#ifdef GREGGB_TRACE_SEQUENCES
+  cpu->printSequences(20); // Candidates for superinstructions
+#endif
+}
+
+// Run CPU and PPU for exactly one frame
+void GB::runFrame() {
+  //  Frames end on fixed multiples of frame_cycles, so cycles the last
+  // instruction runs over by come off the next frame instead of adding up. The
+  // CPU runs up to each PPU event, then the PPU catches up to it
+  frame_end = frame_end + frame_cycles;
+  while (cpu->getCycles() < frame_end) {
+    cpu->runUntil(bus, std::min(frame_end, ppu->nextEvent()));
+    ppu->runUntil(cpu->getCycles());
+  }
+  updateSave();
+}
+
+// Copy RAM pages written since the last call into the save file
+void GB::updateSave() {
+  if (save != nullptr && bus->getMBC()->takeDirtyPages(save_dirty)) {
+    save->update(bus->getMBC()->getRAM(), save_dirty);
+  }
 }
 
 // Get input from keyboard
 void GB::getInput() {};
 
 // Render screen
-void GB::renderScreen() {};
+void GB::renderScreen() {
+  FrameBuffer &frames = ppu->getFrames();
+  if (frames.acquire()) {
+    FrameBuffer::toRGBA(frames.getFront(), screen_rgba.data());
+  }
+}
+
+FrameBuffer& GB::getFrames() {
+  return ppu->getFrames();
+}
 
 // Delete all GB related objects
-GB::~GB() {};
\ No newline at end of file
+GB::~GB() {
+  // Save file goes first, it needs the RAM for any last writes
+  updateSave();
+  delete save;
+  delete ppu;
+  delete cpu;
+  delete bus;
+  Cartridge::release(cart);
+}
\ No newline at end of file
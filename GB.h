@@ -7,9 +7,13 @@ GB class function signatures
 
 // Include libraries
 #include <SFML/Graphics.hpp>
+#include <vector>
 // Include local header files
+#include "Bus.h"
+#include "Cartridge.h"
 #include "CPU.h"
-//#include "PPU.h"
+#include "PPU.h"
+#include "SaveFile.h"
 
 // GB class
 class GB {
@@ -19,17 +23,37 @@ class GB {
     //sf::Texture* scrn_tex;
     //sf::Sprite* scrn_spr;
     CPU* cpu;
-    //PPU* ppu;
-    uint8_t* mem_map;
+    PPU* ppu;
+    Bus* bus;
+    Cartridge* cart;
+    //  Save file for battery backed RAM (nullptr if the cartridge has none), and
+    // the RAM pages written since it was last updated
+    SaveFile* save;
+    std::vector<uint8_t> save_dirty;
+    // Copy RAM pages written since the last call into the save file
+    void updateSave();
+    // T-cycles per frame (154 scanlines of 456 t-cycles)
+    static constexpr uint32_t frame_cycles = 70224;
+    uint64_t frame_end; // T-cycle the current frame ends on
+    std::vector<uint8_t> screen_rgba; // Newest frame as RGBA, for the window
   public:
-    // Create GB object
-    GB();
+    //  Create GB object, loading the Boot ROM and cartridge ROM at these paths
+    // (boot_path nullptr starts from where the Boot ROM would leave off), with a
+    // PPU of ppu_accuracy (a PPU::Accuracy, or -1 for the one picked for the ROM)
+    GB(const char *boot_path, const char *rom_path, int ppu_accuracy);
+    // Turn CPU JIT on or off (lockstep checks it against the interpreter)
+    void setJit(bool enabled, bool lockstep);
     // Emulator loop
     void emuLoop();
+    // Run CPU and PPU for exactly one frame
+    void runFrame();
     // Get input from keyboard
     void getInput();
-    // Render screen
+    // Render screen, converting the newest frame to RGBA if the PPU finished one
     void renderScreen();
+    //  Frames the PPU finished, for a renderer or recorder on another thread to
+    // acquire instead of renderScreen
+    FrameBuffer& getFrames();
     // Delete all GB related objects
     ~GB();
 };
@@ -0,0 +1,321 @@
+/*
+JIT class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+// Include local header files
+#include "JIT.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+// Create JIT object
+JIT::JIT(size_t size) {
+  //  Code buffer, readable and writable but not executable until a block is
+  // compiled into it
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  page_size = info.dwPageSize;
+  code = (uint8_t*)VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+  if (code == nullptr) {
+#else
+  page_size = sysconf(_SC_PAGESIZE);
+  code = (uint8_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+#endif
+    printf("Error: Could not allocate JIT code buffer\n");
+    exit(1);
+  }
+  code_size = size;
+  code_used = 0;
+}
+
+void JIT::protect(size_t first, size_t last, bool writable) {
+  //  Pages are only ever one or the other, compiled code isn't running while a
+  // block is being compiled, so the pages it shares with the new block can be
+  // taken away from it for that long
+  size_t start = first & ~(page_size - 1);
+  size_t end = (last + page_size) & ~(page_size - 1);
+  if (end > code_size) {
+    end = code_size;
+  }
+#if defined(_WIN32)
+  DWORD old_protect;
+  bool ok = VirtualProtect(code + start, end - start, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old_protect);
+  if (ok && !writable) {
+    FlushInstructionCache(GetCurrentProcess(), code + start, end - start);
+  }
+#else
+  bool ok = mprotect(code + start, end - start, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+  if (!ok) {
+    printf("Error: Could not change JIT code buffer protection\n");
+    exit(1);
+  }
+}
+
+void JIT::emit8(uint8_t val) {
+  code[code_used++] = val;
+}
+
+void JIT::emit32(uint32_t val) {
+  memcpy(&code[code_used], &val, 4);
+  code_used = code_used + 4;
+}
+
+void JIT::emit64(uint64_t val) {
+  memcpy(&code[code_used], &val, 8);
+  code_used = code_used + 8;
+}
+
+void JIT::emitMem(uint8_t reg, int32_t disp) {
+  // ModRM and displacement for [rbx + disp] (the CPU object plus disp), reg in the reg field
+  emit8(0x80 | reg << 3 | 3);
+  emit32(disp);
+}
+
+bool JIT::native(uint8_t opcode) {
+  //  Opcodes compiled to x86-64 instead of a handler call, the ones that read or
+  // write F only with eager flags (lazy flags are left to the handlers)
+  if (opcode >= 0x40 && opcode < 0x80) {
+    return (opcode & 0x07) != 0x06 && (opcode & 0x38) != 0x30; // ld r,r' ((hl) and halt aren't)
+  }
+  switch (opcode) {
+    case 0x01: case 0x11: case 0x21: case 0x31: // ld rr,n16
+    case 0x03: case 0x0b: case 0x13: case 0x1b: case 0x23: case 0x2b: case 0x33: case 0x3b: // inc rr, dec rr
+    case 0x06: case 0x0e: case 0x16: case 0x1e: case 0x26: case 0x2e: case 0x3e: // ld r,n8
+    case 0x18: // jr
+      return true;
+    case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x3c: // inc r
+    case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x3d: // dec r
+    case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbf: case 0xfe: // cp
+    case 0x20: case 0x28: case 0x30: case 0x38: // jr cc
+      return !CPU::lazy_flags;
+    default:
+      return false;
+  }
+}
+
+CPU::BlockCode JIT::compile(const CPU &cpu, Bus *bus, const CPU::Instruction *insts, uint16_t count) {
+  //  Worst case size, under 128 bytes per instruction (a handler call with the
+  // clock brought up to date, flush check, and early exit), plus prologue and epilogue
+  if (code_used + count * 128 + 64 > code_size) {
+    return nullptr;
+  }
+  size_t start = code_used;
+  protect(start, start + count * 128 + 63, true);
+  CPU::BlockCode block_code = (CPU::BlockCode)&code[code_used];
+  // Offsets from the CPU object of what compiled code reads and writes
+  const uint8_t *base = (const uint8_t*)&cpu;
+  const int32_t r8_offset[8] = {
+    (int32_t)(&cpu.reg.B - base), (int32_t)(&cpu.reg.C - base), (int32_t)(&cpu.reg.D - base),
+    (int32_t)(&cpu.reg.E - base), (int32_t)(&cpu.reg.H - base), (int32_t)(&cpu.reg.L - base),
+    -1, (int32_t)(&cpu.reg.A - base)
+  };
+  const int32_t r16_offset[4] = {
+    (int32_t)((const uint8_t*)&cpu.reg.BC - base), (int32_t)((const uint8_t*)&cpu.reg.DE - base),
+    (int32_t)((const uint8_t*)&cpu.reg.HL - base), (int32_t)((const uint8_t*)&cpu.reg.SP - base)
+  };
+  int32_t F_offset = &cpu.reg.F - base;
+  int32_t PC_offset = (const uint8_t*)&cpu.reg.PC - base;
+  int32_t flushed_offset = (const uint8_t*)&cpu.blocks_flushed - base;
+  int32_t cycles_offset = (const uint8_t*)&cpu.total_cycles - base;
+  int32_t loop_back_offset = (const uint8_t*)&cpu.loop_back - base;
+  uint32_t exits[CPU::max_block_length]; // Where each flush check's jne offset is
+  // Prologue, keep CPU in rbx, bus in r12, and the clock at the start of the block in r13
+  emit8(0x53); // push rbx
+  emit8(0x41); emit8(0x54); // push r12
+  emit8(0x41); emit8(0x55); // push r13
+#if defined(_WIN32)
+  emit8(0x48); emit8(0x83); emit8(0xec); emit8(0x20); // sub rsp, 32 (shadow space)
+  emit8(0x48); emit8(0x89); emit8(0xcb); // mov rbx, rcx
+  emit8(0x49); emit8(0x89); emit8(0xd4); // mov r12, rdx
+#else
+  emit8(0x48); emit8(0x89); emit8(0xfb); // mov rbx, rdi
+  emit8(0x49); emit8(0x89); emit8(0xf4); // mov r12, rsi
+#endif
+  emit8(0x4c); emit8(0x8b); emitMem(5, cycles_offset); // mov r13, [total_cycles]
+  //  Every instruction but the last takes the cycles recorded for it, so cycles
+  // are only worked out at the end (and at early exits), in eax. PC is only
+  // stored before handler calls and at the end, compiled instructions don't need it
+  uint16_t pc = cpu.reg.PC;
+  bool pc_stored = true;
+  bool last_native = false; // Last instruction was compiled, not a handler call
+  bool branched = false; // It was a jr (which sets PC and eax itself)
+  for (uint16_t i = 0; i < count; i++) {
+    const CPU::Instruction &inst = insts[i];
+    uint8_t opcode = bus->peek8(pc);
+    uint16_t next_pc = pc + inst.length;
+    if (inst.ops == 1 && native(opcode)) {
+      uint8_t x = (opcode >> 3) & 0x07;
+      uint8_t z = opcode & 0x07;
+      if (opcode >= 0x40 && opcode < 0x80) {
+        // ld r,r'
+        emit8(0x0f); emit8(0xb6); emitMem(0, r8_offset[z]); // movzx eax, byte [r']
+        emit8(0x88); emitMem(0, r8_offset[x]); // mov [r], al
+      } else if (opcode >= 0xb8) {
+        // cp r, cp n8, F = Z N C from the sbc table | H from the operands
+        emit8(0x0f); emit8(0xb6); emitMem(0, r8_offset[7]); // movzx eax, byte [A]
+        if (opcode == 0xfe) {
+          emit8(0xb9); emit32(inst.n16 & 0xff); // mov ecx, n8
+        } else {
+          emit8(0x0f); emit8(0xb6); emitMem(1, r8_offset[z]); // movzx ecx, byte [r]
+        }
+        emit8(0x89); emit8(0xc2); // mov edx, eax
+        emit8(0x29); emit8(0xca); // sub edx, ecx
+        emit8(0x81); emit8(0xe2); emit32(0x1ff); // and edx, 0x1ff
+        emit8(0x31); emit8(0xc8); // xor eax, ecx
+        emit8(0x31); emit8(0xd0); // xor eax, edx
+        emit8(0x83); emit8(0xe0); emit8(0x10); // and eax, 0x10
+        emit8(0x01); emit8(0xc0); // add eax, eax
+        emit8(0x48); emit8(0xb9); emit64((uint64_t)CPU::sbc_flags.data()); // mov rcx, sbc_flags
+        emit8(0x0a); emit8(0x04); emit8(0x11); // or al, byte [rcx + rdx]
+        emit8(0x88); emitMem(0, F_offset); // mov [F], al
+      } else if (opcode < 0x40 && z == 0x06) {
+        // ld r,n8
+        emit8(0xc6); emitMem(0, r8_offset[x]); emit8(inst.n16 & 0xff); // mov byte [r], n8
+      } else if (opcode < 0x40 && z == 0x01) {
+        // ld rr,n16
+        emit8(0x66); emit8(0xc7); emitMem(0, r16_offset[x >> 1]); emit8(inst.n16 & 0xff); emit8(inst.n16 >> 8); // mov word [rr], n16
+      } else if (opcode < 0x40 && z == 0x03) {
+        // inc rr, dec rr
+        emit8(0x66); emit8(0xff); emitMem(x & 1, r16_offset[x >> 1]); // inc/dec word [rr]
+      } else if (opcode < 0x40 && (z == 0x04 || z == 0x05)) {
+        // inc r, dec r, F = carry kept | Z N H from the inc/dec table
+        emit8(0x0f); emit8(0xb6); emitMem(0, r8_offset[x]); // movzx eax, byte [r]
+        emit8(0x48); emit8(0xb9); emit64((uint64_t)(z == 0x04 ? CPU::inc_flags.data() : CPU::dec_flags.data())); // mov rcx, table
+        emit8(0x0f); emit8(0xb6); emit8(0x0c); emit8(0x01); // movzx ecx, byte [rcx + rax]
+        emit8(0x0f); emit8(0xb6); emitMem(2, F_offset); // movzx edx, byte [F]
+        emit8(0x83); emit8(0xe2); emit8(0x10); // and edx, 0x10
+        emit8(0x09); emit8(0xca); // or edx, ecx
+        emit8(0x88); emitMem(2, F_offset); // mov [F], dl
+        emit8(0xfe); emit8(z == 0x04 ? 0xc0 : 0xc8); // inc al / dec al
+        emit8(0x88); emitMem(0, r8_offset[x]); // mov [r], al
+      } else {
+        //  jr e8, jr cc,e8 (always a block's last instruction), a backward jump
+        // that is taken sets loop_back like the handler does
+        int8_t e8 = inst.n16 & 0xff;
+        uint32_t not_taken = 0;
+        if (opcode != 0x18) {
+          emit8(0xf6); emitMem(0, F_offset); emit8(opcode < 0x30 ? 0x80 : 0x10); // test byte [F], Z or C
+          emit8(0x0f); emit8(opcode == 0x20 || opcode == 0x30 ? 0x85 : 0x84); // jnz/jz not_taken
+          not_taken = code_used;
+          emit32(0);
+        }
+        emit8(0x66); emit8(0xc7); emitMem(0, PC_offset); emit8((uint16_t)(next_pc + e8) & 0xff); emit8((uint16_t)(next_pc + e8) >> 8); // mov word [PC], target
+        if (e8 < 0) {
+          emit8(0xc6); emitMem(0, loop_back_offset); emit8(1); // mov byte [loop_back], 1
+        }
+        emit8(0xb8); emit32(inst.cycles_before + 12); // mov eax, cycles
+        if (opcode != 0x18) {
+          emit8(0xe9); uint32_t done = code_used; emit32(0); // jmp done
+          uint32_t rel = code_used - (not_taken + 4);
+          memcpy(&code[not_taken], &rel, 4);
+          emit8(0x66); emit8(0xc7); emitMem(0, PC_offset); emit8(next_pc & 0xff); emit8(next_pc >> 8); // mov word [PC], next_pc
+          emit8(0xb8); emit32(inst.cycles_before + inst.cycles); // mov eax, cycles
+          rel = code_used - (done + 4);
+          memcpy(&code[done], &rel, 4);
+        }
+        branched = true;
+      }
+      pc_stored = branched;
+      last_native = true;
+      pc = next_pc;
+      continue;
+    }
+    // Call the instruction's handler, with PC and (if it can write memory) the clock up to date
+    if (!pc_stored) {
+      emit8(0x66); emit8(0xc7); emitMem(0, PC_offset); emit8(pc & 0xff); emit8(pc >> 8); // mov word [PC], pc
+      pc_stored = true;
+    }
+    last_native = false;
+    if (inst.writes) {
+      emit8(0x49); emit8(0x8d); emit8(0x85); emit32(inst.cycles_before); // lea rax, [r13 + cycles_before]
+      emit8(0x48); emit8(0x89); emitMem(0, cycles_offset); // mov [total_cycles], rax
+    }
+#if defined(_WIN32)
+    emit8(0x48); emit8(0x89); emit8(0xd9); // mov rcx, rbx
+    emit8(0x4c); emit8(0x89); emit8(0xe2); // mov rdx, r12
+    emit8(0x41); emit8(0xb8); emit32(inst.n16); // mov r8d, n16
+#else
+    emit8(0x48); emit8(0x89); emit8(0xdf); // mov rdi, rbx
+    emit8(0x4c); emit8(0x89); emit8(0xe6); // mov rsi, r12
+    emit8(0xba); emit32(inst.n16); // mov edx, n16
+#endif
+    emit8(0x48); emit8(0xb8); emit64((uint64_t)inst.handler); // mov rax, handler
+    emit8(0xff); emit8(0xd0); // call rax
+    // Leave if a write flushed the block cache (the rest of the block may be gone)
+    if (i + 1 < count && inst.writes) {
+      emit8(0x80); emit8(0xbb); emit32(flushed_offset); emit8(0x00); // cmp byte [rbx + flushed_offset], 0
+      emit8(0x0f); emit8(0x85); exits[i] = code_used; emit32(0); // jne exit_i
+    }
+    pc = next_pc;
+  }
+  //  Ran the whole block (fused entries run more than 1 instruction), the last
+  // instruction's cycles are what its handler returned if it was called
+  const CPU::Instruction &last = insts[count - 1];
+  if (last_native && !branched) {
+    emit8(0x66); emit8(0xc7); emitMem(0, PC_offset); emit8(pc & 0xff); emit8(pc >> 8); // mov word [PC], pc
+    emit8(0xb8); emit32(last.cycles_before + last.cycles); // mov eax, cycles
+  } else if (!last_native) {
+    emit8(0x0f); emit8(0xb6); emit8(0xc0); // movzx eax, al
+    emit8(0x05); emit32(last.cycles_before); // add eax, cycles_before
+  }
+  uint32_t ops = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    ops = ops + insts[i].ops;
+  }
+  emit8(0x48); emit8(0xb9); emit64((uint64_t)ops << 32); // mov rcx, ops << 32
+  uint32_t epilogue = code_used;
+  emit8(0x48); emit8(0x09); emit8(0xc8); // or rax, rcx
+#if defined(_WIN32)
+  emit8(0x48); emit8(0x83); emit8(0xc4); emit8(0x20); // add rsp, 32
+#endif
+  emit8(0x41); emit8(0x5d); // pop r13
+  emit8(0x41); emit8(0x5c); // pop r12
+  emit8(0x5b); // pop rbx
+  emit8(0xc3); // ret
+  //  Early exits, after an instruction that can write memory (always a handler
+  // call) took the cycles in al, set cycles and instructions run and go to the epilogue
+  ops = 0;
+  for (uint16_t i = 0; i + 1 < count; i++) {
+    ops = ops + insts[i].ops;
+    if (!insts[i].writes) {
+      continue;
+    }
+    uint32_t rel = code_used - (exits[i] + 4);
+    memcpy(&code[exits[i]], &rel, 4);
+    emit8(0x0f); emit8(0xb6); emit8(0xc0); // movzx eax, al
+    emit8(0x05); emit32(insts[i].cycles_before); // add eax, cycles_before
+    emit8(0x48); emit8(0xb9); emit64((uint64_t)ops << 32); // mov rcx, ops << 32
+    emit8(0xe9); emit32(epilogue - (code_used + 4)); // jmp epilogue
+  }
+  protect(start, start + count * 128 + 63, false);
+  return block_code;
+}
+
+void JIT::reset() {
+  // Compiled blocks are only thrown away with the block cache, so start over
+  code_used = 0;
+}
+
+// Delete all JIT related objects
+JIT::~JIT() {
+#if defined(_WIN32)
+  VirtualFree(code, 0, MEM_RELEASE);
+#else
+  munmap(code, code_size);
+#endif
+}
+
+#endif
@@ -0,0 +1,50 @@
+/*
+JIT class function signatures
+*/
+
+#ifndef JIT_H
+#define JIT_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstddef>
+// Include local header files
+#include "CPU.h"
+
+//  x86-64 JIT, turns a cached block into native code. Register loads, inc/dec,
+// cp, and jr are compiled to x86-64 that works on the CPU's registers (and F,
+// with eager flags) directly, other instructions call their handler (no fetch,
+// decode, or table lookup). Returns the cycles taken in the low 32 bits and
+// instructions run in the high 32 bits. Blocks stop early if a write flushes
+// the block cache, same as CPU::runBlock
+class JIT {
+  private:
+    //  Code buffer, never writable and executable at once (W^X), the pages a block
+    // is compiled into are made writable for it, then executable again
+    uint8_t* code;
+    size_t code_size;
+    size_t code_used;
+    size_t page_size;
+    // Make code buffer bytes first to last (rounded out to whole pages) writable or executable
+    void protect(size_t first, size_t last, bool writable);
+    // Emit bytes into code buffer
+    void emit8(uint8_t val);
+    void emit32(uint32_t val);
+    void emit64(uint64_t val);
+    // Emit ModRM and displacement for [rbx + disp] (rbx holds the CPU object)
+    void emitMem(uint8_t reg, int32_t disp);
+    // Opcodes compiled to x86-64 instead of calling their handler
+    static bool native(uint8_t opcode);
+  public:
+    // Create JIT object with a code buffer of 'size' bytes
+    JIT(size_t size);
+    //  Compile the block of count instructions starting at cpu's PC (opcodes are
+    // peeked from bus), returns nullptr if the code buffer is full
+    CPU::BlockCode compile(const CPU &cpu, Bus *bus, const CPU::Instruction *insts, uint16_t count);
+    // Throw away all compiled code
+    void reset();
+    // Delete all JIT related objects
+    ~JIT();
+};
+
+#endif
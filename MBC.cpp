@@ -0,0 +1,269 @@
+/*
+MBC class function definitions
+*/
+
+// Include libraries
+#include <algorithm>
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+// Include local header files
+#include "MBC.h"
+
+// Create MBC object
+MBC::MBC(Bus &bus, const uint8_t *rom, size_t rom_size, uint8_t *ram, uint32_t ram_size) : bus(bus) {
+  type = getType(rom);
+  this->rom = rom;
+  rom_banks = rom_size / 0x4000;
+  this->ram = ram;
+  this->ram_size = ram_size;
+  ram_banks = type == MBC2 ? 0 : ram_size / 0x2000;
+  ram_offset = 0;
+  battery = hasBattery(rom[0x147]);
+  ram_written = false;
+  ram_dirty.assign((ram_size + 0xff) / 0x100, 0);
+  // Registers start out at bank 0 (1 for 0x4000-0x7fff) with RAM disabled
+  ram_enabled = false;
+  rom_bank = type == MBC5 ? 1 : 0;
+  ram_bank = 0;
+  mode = false;
+  latch = 0xff;
+  memset(rtc, 0, sizeof(rtc));
+  memset(rtc_latched, 0, sizeof(rtc_latched));
+  mapBanks();
+}
+
+MBC::Type MBC::getType(const uint8_t *rom) {
+  // Cartridge type byte in the header
+  Type type;
+  if (!lookupType(rom[0x147], type)) {
+    printf("Error: Cartridge type %02x is not emulated\n", rom[0x147]);
+    exit(1); // Exit program with error
+  }
+  return type;
+}
+
+bool MBC::lookupType(uint8_t cartridge_type, Type &type) {
+  switch (cartridge_type) {
+    case 0x00: case 0x08: case 0x09:
+      type = NO_MBC;
+      return true;
+    case 0x01: case 0x02: case 0x03:
+      type = MBC1;
+      return true;
+    case 0x05: case 0x06:
+      type = MBC2;
+      return true;
+    case 0x0f: case 0x10: case 0x11: case 0x12: case 0x13:
+      type = MBC3;
+      return true;
+    case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e:
+      type = MBC5;
+      return true;
+    default:
+      return false;
+  }
+}
+
+const char* MBC::typeName(Type type) {
+  static const char *const names[5] = {"ROM only", "MBC1", "MBC2", "MBC3", "MBC5"};
+  return names[type];
+}
+
+bool MBC::hasBattery(uint8_t cartridge_type) {
+  switch (cartridge_type) {
+    case 0x03: case 0x06: case 0x09: case 0x0f: case 0x10: case 0x13: case 0x1b: case 0x1e:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint32_t MBC::ramSize(const uint8_t *rom) {
+  //  MBC2 has 512 half bytes built in, otherwise the header's RAM size byte says,
+  // 2KB RAM gets a whole 8KB bank so the bank's pages never point past the end
+  static const uint32_t ram_sizes[6] = {0, 0x2000, 0x2000, 0x8000, 0x20000, 0x10000};
+  if (getType(rom) == MBC2) {
+    return 512;
+  }
+  return rom[0x149] < 6 ? ram_sizes[rom[0x149]] : 0;
+}
+
+void MBC::write(uint16_t addr, uint8_t val) {
+  switch (type) {
+    case NO_MBC:
+      return;
+    case MBC1:
+      if (addr < 0x2000) {
+        ram_enabled = (val & 0x0f) == 0x0a;
+      } else if (addr < 0x4000) {
+        rom_bank = val & 0x1f;
+      } else if (addr < 0x6000) {
+        ram_bank = val & 0x03;
+      } else {
+        mode = val & 0x01;
+      }
+      break;
+    case MBC2:
+      // Bit 8 of the address picks the register, 0x4000-0x7fff does nothing
+      if (addr >= 0x4000) {
+        return;
+      }
+      if (addr & 0x100) {
+        rom_bank = val & 0x0f;
+      } else {
+        ram_enabled = (val & 0x0f) == 0x0a;
+      }
+      break;
+    case MBC3:
+      if (addr < 0x2000) {
+        ram_enabled = (val & 0x0f) == 0x0a;
+      } else if (addr < 0x4000) {
+        rom_bank = val & 0x7f;
+      } else if (addr < 0x6000) {
+        ram_bank = val;
+      } else {
+        // Writing 0 then 1 copies the RTC registers to the ones reads see
+        if (latch == 0x00 && val == 0x01) {
+          memcpy(rtc_latched, rtc, sizeof(rtc));
+        }
+        latch = val;
+        return;
+      }
+      break;
+    case MBC5:
+      if (addr < 0x2000) {
+        ram_enabled = (val & 0x0f) == 0x0a;
+      } else if (addr < 0x3000) {
+        rom_bank = (rom_bank & 0x100) | val;
+      } else if (addr < 0x4000) {
+        rom_bank = (rom_bank & 0xff) | ((val & 0x01) << 8);
+      } else if (addr < 0x6000) {
+        ram_bank = val & 0x0f;
+      } else {
+        return;
+      }
+      break;
+  }
+  mapBanks();
+}
+
+void MBC::mapBanks() {
+  //  Work out the banks for 0x0000-0x3fff and 0x4000-0x7fff, bank 0 can't be put
+  // at 0x4000-0x7fff except on MBC5 (MBC1 only checks its low 5 bits for it)
+  uint32_t low_bank = 0;
+  uint32_t high_bank = rom_bank;
+  uint32_t ram_index = ram_bank;
+  switch (type) {
+    case NO_MBC:
+      high_bank = 1;
+      ram_index = 0;
+      break;
+    case MBC1:
+      high_bank = (ram_bank << 5) | (rom_bank == 0 ? 1 : rom_bank);
+      low_bank = mode ? ram_bank << 5 : 0;
+      ram_index = mode ? ram_bank : 0;
+      break;
+    case MBC2:
+    case MBC3:
+      high_bank = rom_bank == 0 ? 1 : rom_bank;
+      break;
+    case MBC5:
+      break;
+  }
+  bus.mapLowROM(rom + (low_bank % rom_banks) * 0x4000);
+  bus.mapHighROM(rom + (high_bank % rom_banks) * 0x4000);
+  // External RAM (always enabled if there is no MBC)
+  if (type == MBC2 && ram_enabled) {
+    bus.unmapExtRAM(&MBC::readMBC2RAM, &MBC::writeMBC2RAM);
+  } else if (type == MBC3 && ram_enabled && ram_bank >= 0x08 && ram_bank <= 0x0c) {
+    bus.unmapExtRAM(&MBC::readRTC, &MBC::writeRTC);
+  } else if (ram_banks > 0 && (ram_enabled || type == NO_MBC)) {
+    ram_offset = (ram_index % ram_banks) * 0x2000;
+    bus.mapExtRAM(ram + ram_offset, battery ? &MBC::writeSaveRAM : nullptr);
+  } else {
+    bus.unmapExtRAM(&Bus::readOpenBus, &Bus::writeIgnored);
+  }
+}
+
+MBC::State MBC::getState() {
+  State state;
+  memset(&state, 0, sizeof(state));
+  state.ram_enabled = ram_enabled;
+  state.rom_bank = rom_bank;
+  state.ram_bank = ram_bank;
+  state.mode = mode;
+  state.latch = latch;
+  memcpy(state.rtc, rtc, sizeof(rtc));
+  memcpy(state.rtc_latched, rtc_latched, sizeof(rtc_latched));
+  state.ram_offset = ram_offset;
+  return state;
+}
+
+void MBC::setState(const State &state) {
+  ram_enabled = state.ram_enabled;
+  rom_bank = state.rom_bank;
+  ram_bank = state.ram_bank;
+  mode = state.mode;
+  latch = state.latch;
+  memcpy(rtc, state.rtc, sizeof(rtc));
+  memcpy(rtc_latched, state.rtc_latched, sizeof(rtc_latched));
+  ram_offset = state.ram_offset;
+  mapBanks();
+}
+
+// External RAM handlers
+void MBC::writeSaveRAM(Bus &bus, uint16_t addr, uint8_t val) {
+  // Battery backed RAM, note which page was written so it gets saved
+  MBC *mbc = bus.getMBC();
+  uint32_t offset = mbc->ram_offset + (addr & 0x1fff);
+  mbc->ram[offset] = val;
+  mbc->ram_dirty[offset >> 8] = 1;
+  bus.markDirty(mbc->ram + offset);
+  mbc->ram_written = true;
+}
+
+uint8_t MBC::readMBC2RAM(Bus &bus, uint16_t addr) {
+  // 512 half bytes repeated over 0xa000-0xbfff, the top half of each reads as 1s
+  return bus.getMBC()->ram[addr & 0x1ff] | 0xf0;
+}
+
+void MBC::writeMBC2RAM(Bus &bus, uint16_t addr, uint8_t val) {
+  MBC *mbc = bus.getMBC();
+  mbc->ram[addr & 0x1ff] = val & 0x0f;
+  mbc->ram_dirty[(addr & 0x1ff) >> 8] = 1;
+  bus.markDirty(mbc->ram + (addr & 0x1ff));
+  mbc->ram_written = true;
+}
+
+uint8_t MBC::readRTC(Bus &bus, uint16_t) {
+  MBC *mbc = bus.getMBC();
+  return mbc->rtc_latched[mbc->ram_bank - 0x08];
+}
+
+void MBC::writeRTC(Bus &bus, uint16_t, uint8_t val) {
+  //  The clock doesn't tick yet, so writes show up in reads straight away
+  // instead of waiting for the next latch
+  MBC *mbc = bus.getMBC();
+  mbc->rtc[mbc->ram_bank - 0x08] = val;
+  mbc->rtc_latched[mbc->ram_bank - 0x08] = val;
+}
+
+uint8_t* MBC::getRAM() {
+  return ram;
+}
+
+uint32_t MBC::getRAMSize() {
+  return ram_size;
+}
+
+bool MBC::takeDirtyPages(std::vector<uint8_t> &dirty) {
+  if (!ram_written) {
+    return false;
+  }
+  dirty = ram_dirty;
+  std::fill(ram_dirty.begin(), ram_dirty.end(), 0);
+  ram_written = false;
+  return true;
+}
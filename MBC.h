@@ -0,0 +1,95 @@
+/*
+MBC class function signatures
+*/
+
+#ifndef MBC_H
+#define MBC_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstddef>
+#include <vector>
+// Include local header files
+#include "Bus.h"
+
+//  Memory bank controller, the cartridge chip that picks which ROM and external
+// RAM banks the CPU sees. Writing its registers (anywhere in 0x0000-0x7fff)
+// points the bus's pages at the banks they select, nothing is copied, so a bank
+// switch costs the same however often a game does it
+class MBC {
+  public:
+    enum Type : uint8_t {NO_MBC, MBC1, MBC2, MBC3, MBC5};
+    //  Registers (and the RAM bank they leave mapped), as plain data so they can be
+    // copied and compared, for JIT lockstep to put them back
+    struct State {
+      bool ram_enabled;
+      uint16_t rom_bank;
+      uint8_t ram_bank;
+      bool mode;
+      uint8_t latch;
+      uint8_t rtc[5];
+      uint8_t rtc_latched[5];
+      uint32_t ram_offset;
+    };
+  private:
+    Bus &bus;
+    Type type;
+    const uint8_t* rom;
+    uint32_t rom_banks; // Number of 16KB ROM banks
+    uint8_t* ram;
+    uint32_t ram_size;
+    uint32_t ram_banks; // Number of 8KB RAM banks (0 for MBC2's 512 half bytes)
+    uint32_t ram_offset; // Offset of the bank at 0xa000-0xbfff in ram
+    //  Battery backed RAM, writes go through writeSaveRAM so 256 byte pages written
+    // since the last takeDirtyPages are known, and only those need saving
+    bool battery;
+    bool ram_written;
+    std::vector<uint8_t> ram_dirty; // 1 per 256 bytes of ram, set if written
+    // Registers
+    bool ram_enabled;
+    uint16_t rom_bank; // ROM bank (MBC1: low 5 bits of it)
+    //  RAM bank (MBC1: also bits 5-6 of the ROM bank, MBC3: 0x08-0x0c select an
+    // RTC register instead)
+    uint8_t ram_bank;
+    bool mode; // MBC1 banking mode (1 = ram_bank also switches 0x0000-0x3fff and RAM)
+    uint8_t latch; // MBC3 last write to the latch register
+    //  MBC3 RTC registers (seconds, minutes, hours, day low, day high and flags),
+    // reads see the copy made at the last latch
+    uint8_t rtc[5];
+    uint8_t rtc_latched[5];
+    // Point the bus at the banks the registers select
+    void mapBanks();
+    // External RAM handlers, for battery backed RAM, MBC2's built in RAM, and MBC3's RTC registers
+    static void writeSaveRAM(Bus &bus, uint16_t addr, uint8_t val);
+    static uint8_t readMBC2RAM(Bus &bus, uint16_t addr);
+    static void writeMBC2RAM(Bus &bus, uint16_t addr, uint8_t val);
+    static uint8_t readRTC(Bus &bus, uint16_t addr);
+    static void writeRTC(Bus &bus, uint16_t addr, uint8_t val);
+  public:
+    //  Create MBC object for a cartridge's ROM (rom_size bytes, whole 16KB banks)
+    // and external RAM (ram_size bytes, from ramSize), and map its first banks
+    MBC(Bus &bus, const uint8_t *rom, size_t rom_size, uint8_t *ram, uint32_t ram_size);
+    //  MBC, external RAM size (in bytes), and whether the RAM is battery backed,
+    // as the cartridge header says
+    static Type getType(const uint8_t *rom);
+    static uint32_t ramSize(const uint8_t *rom);
+    static bool hasBattery(uint8_t cartridge_type);
+    //  MBC for a cartridge type byte (0x147), returns false if it isn't one that
+    // is emulated, and the MBC's name
+    static bool lookupType(uint8_t cartridge_type, Type &type);
+    static const char* typeName(Type type);
+    // External RAM (getRAMSize() bytes, all banks)
+    uint8_t* getRAM();
+    uint32_t getRAMSize();
+    //  Copy the dirty flags (1 per 256 bytes of RAM) into dirty and clear them,
+    // returns false (leaving dirty alone) if nothing was written since
+    bool takeDirtyPages(std::vector<uint8_t> &dirty);
+    // Write an MBC register
+    void write(uint16_t addr, uint8_t val);
+    //  Registers, and setting them back (mapping the banks they select), padding
+    // is zeroed so two States can be compared with memcmp
+    State getState();
+    void setState(const State &state);
+};
+
+#endif
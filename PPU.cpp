@@ -0,0 +1,514 @@
+/*
+PPU class function definitions
+*/
+
+// Include libraries
+#include <algorithm>
+#include <cinttypes> // To use uint*_t
+#include <cstring>
+#include <string>
+// Include local header files
+#include "Bus.h"
+#include "CartridgeHeader.h"
+#include "CPU.h"
+#include "PPU.h"
+
+// Create PPU object
+PPU::PPU(Bus &bus, CPU &cpu, Accuracy accuracy) : bus(bus), cpu(cpu), tiles(bus), kernels(RenderKernels::get()) {
+  this->accuracy = accuracy;
+  if (accuracy == ACCURACY_PIXEL_FIFO) {
+    run_event = &PPU::runEvent<PixelFIFOPolicy>;
+    draw_until = &PPU::drawUntil<PixelFIFOPolicy>;
+  } else {
+    run_event = &PPU::runEvent<ScanlinePolicy>;
+    draw_until = &PPU::drawUntil<ScanlinePolicy>;
+  }
+  memset(&fifo, 0, sizeof(fifo));
+  event = LINE_START;
+  next_event = UINT64_MAX;
+  line_start = 0;
+  ly = 0;
+  mode = 0;
+  lcd_on = false;
+  stat_line = false;
+  window_line = 0;
+  sprite_count = 0;
+  frame_count = 0;
+  // Pick up the LCD as it is now (on at line 0 if the boot ROM was skipped)
+  lcdcWritten();
+}
+
+uint8_t PPU::readIO(uint16_t addr) {
+  return bus.getMemory()[Bus::memoryOffset(addr)];
+}
+
+void PPU::writeIO(uint16_t addr, uint8_t val) {
+  uint8_t *reg = bus.getMemory() + Bus::memoryOffset(addr);
+  *reg = val;
+  bus.markDirty(reg);
+}
+
+void PPU::setMode(uint8_t mode) {
+  this->mode = mode;
+  writeIO(0xff41, (readIO(0xff41) & 0xfc) | mode);
+}
+
+void PPU::setLY(uint8_t ly) {
+  // LY=LYC (STAT bit 2) is compared whenever LY or LYC changes
+  this->ly = ly;
+  writeIO(0xff44, ly);
+  writeIO(0xff41, (readIO(0xff41) & 0xfb) | (ly == readIO(0xff45) ? 0x04 : 0x00));
+}
+
+void PPU::updateStat() {
+  //  The STAT interrupt sources enabled in STAT bits 3-6 are ORed into one line,
+  // so a source only requests the interrupt if none of the others already held
+  // the line high
+  uint8_t stat = readIO(0xff41);
+  bool line = lcd_on && (((stat & 0x08) && mode == 0) || ((stat & 0x10) && mode == 1)
+  || ((stat & 0x20) && mode == 2) || ((stat & 0x40) && (stat & 0x04)));
+  if (line && !stat_line) {
+    bus.requestInterrupt(0x02);
+  }
+  stat_line = line;
+}
+
+uint64_t PPU::nextEvent() {
+  return next_event;
+}
+
+void PPU::runUntil(uint64_t cycle) {
+  while (next_event <= cycle) {
+    (this->*run_event)();
+  }
+}
+
+void PPU::sync() {
+  // Catch up with the CPU before a register write changes what comes next
+  uint64_t cycle = cpu.getCycles();
+  runUntil(cycle);
+  (this->*draw_until)(cycle);
+}
+
+template <class Policy>
+void PPU::drawUntil(uint64_t cycle) {
+  // Only the pixel FIFO draws part of a line, up to the dot the CPU is at
+  if constexpr (Policy::pixel_fifo) {
+    if (mode == 3) {
+      stepFIFO(cycle - (line_start + oam_scan_cycles));
+    }
+  }
+}
+
+template <class Policy>
+void PPU::runEvent() {
+  switch (event) {
+    case LINE_START:
+      line_start = next_event;
+      ly = ly + 1 == lines ? 0 : ly + 1;
+      startLine();
+      break;
+    case DRAW: {
+      //  Mode 3 gets longer for the pixels SCX throws away and for each sprite
+      // on the line. The scanline renderer uses an average of the real sprite
+      // penalty (which depends on where each sprite is), the pixel FIFO checks
+      // back at the shortest drawing could take and runs on until it is done
+      setMode(3);
+      scanOAM();
+      uint32_t draw_cycles = 172 + (readIO(0xff43) & 0x07);
+      if constexpr (Policy::pixel_fifo) {
+        startFIFO();
+      } else {
+        renderLine();
+        draw_cycles = draw_cycles + 6 * sprite_count;
+      }
+      event = HBLANK;
+      next_event = line_start + oam_scan_cycles + draw_cycles;
+      updateStat();
+      break;
+    }
+    case HBLANK:
+      if constexpr (Policy::pixel_fifo) {
+        stepFIFO(next_event - (line_start + oam_scan_cycles));
+        if (fifo.x < screen_width) {
+          next_event = next_event + (screen_width - fifo.x);
+          break;
+        }
+        if (fifo.window) {
+          window_line++;
+        }
+      }
+      setMode(0);
+      event = LINE_START;
+      next_event = line_start + line_cycles;
+      updateStat();
+      break;
+  }
+}
+
+void PPU::startLine() {
+  // Visible lines start with OAM scan, VBlank starts at line 144
+  if (ly == 0) {
+    window_line = 0;
+  }
+  setLY(ly);
+  if (ly < screen_height) {
+    setMode(2);
+    event = DRAW;
+    next_event = line_start + oam_scan_cycles;
+  } else {
+    if (ly == screen_height) {
+      setMode(1);
+      bus.requestInterrupt(0x01);
+      frames.publish();
+      frame_count++;
+    }
+    event = LINE_START;
+    next_event = line_start + line_cycles;
+  }
+  updateStat();
+}
+
+void PPU::scanOAM() {
+  //  The first 10 sprites (in OAM order) on this line, then sorted by X as lower
+  // X draws on top (OAM order breaks ties)
+  const uint8_t *oam = bus.getMemory() + Bus::memoryOffset(0xfe00);
+  uint8_t height = readIO(0xff40) & 0x04 ? 16 : 8;
+  sprite_count = 0;
+  for (uint8_t i = 0; i < 40 && sprite_count < 10; i++) {
+    uint8_t y = oam[i * 4];
+    if (ly + 16 >= y && ly + 16 < y + height) {
+      sprites[sprite_count++] = i;
+    }
+  }
+  for (uint8_t i = 1; i < sprite_count; i++) {
+    uint8_t sprite = sprites[i];
+    uint8_t j = i;
+    for (; j > 0 && oam[sprites[j - 1] * 4 + 1] > oam[sprite * 4 + 1]; j--) {
+      sprites[j] = sprites[j - 1];
+    }
+    sprites[j] = sprite;
+  }
+}
+
+uint16_t PPU::tileIndex(uint8_t lcdc, uint8_t tile) {
+  //  Background and window tiles are at 0x8000 + tile * 16 with LCDC bit 4 set,
+  // otherwise at 0x9000 + tile * 16 with tile signed
+  return lcdc & 0x10 ? tile : 256 + (int8_t)tile;
+}
+
+void PPU::renderLine() {
+  // Render line ly into the back buffer, with the registers as they are now
+  const uint8_t *memory = bus.getMemory();
+  const uint8_t *vram = memory + Bus::memoryOffset(0x8000);
+  const uint8_t *oam = memory + Bus::memoryOffset(0xfe00);
+  uint8_t lcdc = readIO(0xff40);
+  uint8_t *out = frames.getBack() + ly * screen_width;
+  // Background and window color numbers, sprites behind them only show over 0
+  uint8_t colors[screen_width];
+  memset(colors, 0, sizeof(colors));
+  if (lcdc & 0x01) {
+    //  Window covers the background from WX - 7 right if it is on and this line
+    // is at or below WY
+    uint8_t wx = readIO(0xff4b);
+    bool window = (lcdc & 0x20) && ly >= readIO(0xff4a) && wx <= 166;
+    uint32_t window_x = window ? (wx < 7 ? 0 : wx - 7) : screen_width;
+    uint16_t map = lcdc & 0x08 ? 0x1c00 : 0x1800;
+    //  Copied a tile row at a time out of the tile cache, the first one cut
+    // short by however far SCX scrolls into it
+    uint8_t y = ly + readIO(0xff42);
+    uint8_t map_x = readIO(0xff43);
+    for (uint32_t x = 0; x < window_x;) {
+      const uint8_t *row = tiles.row(tileIndex(lcdc, vram[map + (y / 8) * 32 + map_x / 8]), y & 7, false);
+      uint32_t count = std::min<uint32_t>(8 - (map_x & 7), window_x - x);
+      memcpy(colors + x, row + (map_x & 7), count);
+      x = x + count;
+      map_x = map_x + count;
+    }
+    if (window) {
+      map = lcdc & 0x40 ? 0x1c00 : 0x1800;
+      map_x = window_x + 7 - wx;
+      for (uint32_t x = window_x; x < screen_width;) {
+        const uint8_t *row = tiles.row(tileIndex(lcdc, vram[map + (window_line / 8) * 32 + map_x / 8]), window_line & 7, false);
+        uint32_t count = std::min<uint32_t>(8 - (map_x & 7), screen_width - x);
+        memcpy(colors + x, row + (map_x & 7), count);
+        x = x + count;
+        map_x = map_x + count;
+      }
+      window_line++;
+    }
+  }
+  kernels.applyPalette(colors, readIO(0xff47), out, screen_width);
+  if (!(lcdc & 0x02) || sprite_count == 0) {
+    return;
+  }
+  //  Sprites in priority order, each pixel goes to the first sprite with a
+  // color other than 0 there, even if that sprite is then hidden behind the
+  // background (attribute bit 7), then they are merged over the line in one go
+  uint8_t height = lcdc & 0x04 ? 16 : 8;
+  uint8_t sprite_shades[screen_width];
+  uint8_t opaque[screen_width];
+  uint8_t behind[screen_width];
+  memset(sprite_shades, 0, sizeof(sprite_shades));
+  memset(opaque, 0, sizeof(opaque));
+  memset(behind, 0, sizeof(behind));
+  for (uint8_t i = 0; i < sprite_count; i++) {
+    const uint8_t *sprite = oam + sprites[i] * 4;
+    uint8_t attributes = sprite[3];
+    uint8_t row = ly + 16 - sprite[0];
+    if (attributes & 0x40) {
+      row = height - 1 - row;
+    }
+    //  Sprites always use 0x8000 addressing, the bottom half of an 8x16 sprite is
+    // the next tile
+    uint8_t tile = height == 16 ? (sprite[2] & 0xfe) + (row >> 3) : sprite[2];
+    const uint8_t *data = tiles.row(tile, row & 7, attributes & 0x20);
+    uint8_t palette = readIO(attributes & 0x10 ? 0xff49 : 0xff48);
+    for (int pixel = 0; pixel < 8; pixel++) {
+      int x = sprite[1] - 8 + pixel;
+      if (x < 0 || x >= (int)screen_width || opaque[x]) {
+        continue;
+      }
+      uint8_t color = data[pixel];
+      if (color == 0) {
+        continue;
+      }
+      opaque[x] = 0xff;
+      behind[x] = attributes & 0x80 ? 0xff : 0x00;
+      sprite_shades[x] = (palette >> (color * 2)) & 0x03;
+    }
+  }
+  kernels.mergeSprites(out, colors, sprite_shades, opaque, behind, screen_width);
+}
+
+// Register writes
+void PPU::writeLCDC(uint8_t val) {
+  //  Turning the LCD on starts line 0 now, turning it off leaves LY at 0 in
+  // HBlank with nothing scheduled until it comes back on
+  sync();
+  writeIO(0xff40, val);
+  lcdcWritten();
+}
+
+void PPU::lcdcWritten() {
+  bool on = readIO(0xff40) & 0x80;
+  if (on == lcd_on) {
+    return;
+  }
+  lcd_on = on;
+  if (on) {
+    ly = 0;
+    line_start = cpu.getCycles();
+    startLine();
+    cpu.stopAt(next_event);
+  } else {
+    event = LINE_START;
+    next_event = UINT64_MAX;
+    setLY(0);
+    setMode(0);
+    updateStat();
+    // The screen goes blank while the LCD is off
+    memset(frames.getBack(), 0, screen_width * screen_height);
+    frames.publish();
+  }
+}
+
+void PPU::writeSTAT(uint8_t val) {
+  // The mode and LY=LYC bits (0-2) are read only
+  sync();
+  writeIO(0xff41, (readIO(0xff41) & 0x07) | (val & 0x78));
+  updateStat();
+}
+
+void PPU::writeLYC(uint8_t val) {
+  sync();
+  writeIO(0xff45, val);
+  setLY(ly);
+  updateStat();
+}
+
+void PPU::writeRegister(uint16_t addr, uint8_t val) {
+  sync();
+  writeIO(addr, val);
+}
+
+const std::vector<PPU::ROMKey> PPU::pixel_fifo_roms = {
+  //  None listed yet, add a ROM's title and header and global checksums (as
+  // --index shows them) here when it needs writes part way through a line drawn
+  // exactly
+};
+
+PPU::Accuracy PPU::accuracyFor(CartridgeHeader &header) {
+  // Few enough ROMs to go through them all
+  std::string title = header.getTitle();
+  for (const ROMKey &key : pixel_fifo_roms) {
+    if (key.header_checksum == header.getHeaderChecksum()
+    && key.global_checksum == header.getGlobalChecksum() && title == key.title) {
+      return ACCURACY_PIXEL_FIFO;
+    }
+  }
+  return ACCURACY_SCANLINE;
+}
+
+PPU::Accuracy PPU::getAccuracy() {
+  return accuracy;
+}
+
+// Pixel FIFO
+void PPU::startFIFO() {
+  //  The first tile fetch of a line is thrown away, 6 dots before the real one
+  // starts, so the first pixel comes out on dot 12 (plus SCX & 7 dropped)
+  fifo.x = 0;
+  fifo.dot = 0;
+  fifo.fetch_step = -6;
+  fifo.fetch_x = 0;
+  fifo.bg_head = 0;
+  fifo.bg_count = 0;
+  fifo.discard = readIO(0xff43) & 0x07;
+  fifo.stall = 0;
+  fifo.next_sprite = 0;
+  fifo.window = false;
+  memset(fifo.obj, 0, sizeof(fifo.obj));
+}
+
+void PPU::fetchSprite(uint8_t index) {
+  // Fill the sprite pixels no sprite fetched before this one has claimed
+  const uint8_t *sprite = bus.getMemory() + Bus::memoryOffset(0xfe00) + sprites[index] * 4;
+  uint8_t height = readIO(0xff40) & 0x04 ? 16 : 8;
+  uint8_t attributes = sprite[3];
+  uint8_t row = ly + 16 - sprite[0];
+  if (attributes & 0x40) {
+    row = height - 1 - row;
+  }
+  uint8_t tile = height == 16 ? (sprite[2] & 0xfe) + (row >> 3) : sprite[2];
+  const uint8_t *data = tiles.row(tile, row & 7, attributes & 0x20);
+  for (int pixel = 0; pixel < 8; pixel++) {
+    uint8_t &slot = fifo.obj[sprite[1] + pixel];
+    if (slot == 0 && data[pixel] != 0) {
+      slot = data[pixel] | (attributes & 0x90);
+    }
+  }
+}
+
+void PPU::stepFIFO(uint32_t dot) {
+  //  Each dot: start a sprite's fetch if one starts at this X (stalling for 6
+  // dots, plus however long the background fetch has left), switch to the window
+  // once X reaches WX - 7, advance the background fetcher (a tile row every 6
+  // dots, pushed once the FIFO is empty), then send one pixel to the LCD. Every
+  // register is read on the dot it is used
+  uint8_t *out = frames.getBack() + ly * screen_width;
+  while (fifo.dot < dot && fifo.x < screen_width) {
+    uint8_t lcdc = readIO(0xff40);
+    if (fifo.stall > 0) {
+      fifo.stall--;
+      fifo.dot++;
+      continue;
+    }
+    if (fifo.next_sprite < sprite_count) {
+      uint8_t sprite_x = bus.getMemory()[Bus::memoryOffset(0xfe00) + sprites[fifo.next_sprite] * 4 + 1];
+      if (sprite_x <= fifo.x + 8) {
+        if (lcdc & 0x02) {
+          fetchSprite(fifo.next_sprite);
+          fifo.stall = 6 + (fifo.fetch_step >= 0 && fifo.fetch_step < 5 ? 5 - fifo.fetch_step : 0);
+        }
+        fifo.next_sprite++;
+        continue;
+      }
+    }
+    uint8_t wx = readIO(0xff4b);
+    if (!fifo.window && (lcdc & 0x21) == 0x21 && ly >= readIO(0xff4a) && fifo.x + 7 >= wx) {
+      //  The window restarts the fetcher from its own first column, at WX < 7
+      // the pixels left of the screen are dropped
+      fifo.window = true;
+      fifo.fetch_step = 0;
+      fifo.fetch_x = 0;
+      fifo.bg_count = 0;
+      fifo.discard = fifo.x == 0 && wx < 7 ? 7 - wx : 0;
+    }
+    if (fifo.fetch_step < 6) {
+      fifo.fetch_step++;
+    }
+    if (fifo.fetch_step == 6 && fifo.bg_count == 0) {
+      const uint8_t *vram = bus.getMemory() + Bus::memoryOffset(0x8000);
+      const uint8_t *row;
+      if (fifo.window) {
+        uint16_t map = lcdc & 0x40 ? 0x1c00 : 0x1800;
+        row = tiles.row(tileIndex(lcdc, vram[map + (window_line / 8) * 32 + (fifo.fetch_x & 31)]), window_line & 7, false);
+      } else {
+        uint16_t map = lcdc & 0x08 ? 0x1c00 : 0x1800;
+        uint8_t y = ly + readIO(0xff42);
+        uint8_t column = ((readIO(0xff43) >> 3) + fifo.fetch_x) & 31;
+        row = tiles.row(tileIndex(lcdc, vram[map + (y / 8) * 32 + column]), y & 7, false);
+      }
+      memcpy(fifo.bg, row, 8);
+      fifo.bg_head = 0;
+      fifo.bg_count = 8;
+      fifo.fetch_x++;
+      fifo.fetch_step = 0;
+    }
+    if (fifo.bg_count > 0) {
+      uint8_t color = fifo.bg[fifo.bg_head++];
+      fifo.bg_count--;
+      if (fifo.discard > 0) {
+        fifo.discard--;
+      } else {
+        // LCDC bit 0 blanks the background and window, sprites still show
+        if (!(lcdc & 0x01)) {
+          color = 0;
+        }
+        uint8_t shade = (readIO(0xff47) >> (color * 2)) & 0x03;
+        uint8_t sprite = fifo.obj[fifo.x + 8];
+        if (sprite != 0 && (lcdc & 0x02) && (!(sprite & 0x80) || color == 0)) {
+          shade = (readIO(sprite & 0x10 ? 0xff49 : 0xff48) >> ((sprite & 0x03) * 2)) & 0x03;
+        }
+        out[fifo.x++] = shade;
+      }
+    }
+    fifo.dot++;
+  }
+}
+
+void PPU::vramChanged() {
+  tiles.invalidateAll();
+}
+
+PPU::State PPU::getState() {
+  State state;
+  memset(&state, 0, sizeof(state));
+  state.event = event;
+  state.next_event = next_event;
+  state.line_start = line_start;
+  state.ly = ly;
+  state.mode = mode;
+  state.lcd_on = lcd_on;
+  state.stat_line = stat_line;
+  state.window_line = window_line;
+  memcpy(state.sprites, sprites, sizeof(sprites));
+  state.sprite_count = sprite_count;
+  state.frame_count = frame_count;
+  memcpy(&state.fifo, &fifo, sizeof(fifo));
+  return state;
+}
+
+void PPU::setState(const State &state) {
+  event = state.event;
+  next_event = state.next_event;
+  line_start = state.line_start;
+  ly = state.ly;
+  mode = state.mode;
+  lcd_on = state.lcd_on;
+  stat_line = state.stat_line;
+  window_line = state.window_line;
+  memcpy(sprites, state.sprites, sizeof(sprites));
+  sprite_count = state.sprite_count;
+  frame_count = state.frame_count;
+  memcpy(&fifo, &state.fifo, sizeof(fifo));
+}
+
+FrameBuffer& PPU::getFrames() {
+  return frames;
+}
+
+uint32_t PPU::getFrameCount() {
+  return frame_count;
+}
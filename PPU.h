@@ -0,0 +1,173 @@
+/*
+PPU class function signatures
+*/
+
+#ifndef PPU_H
+#define PPU_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <vector>
+// Include local header files
+#include "FrameBuffer.h"
+#include "RenderKernels.h"
+#include "TileCache.h"
+
+class Bus;
+class CartridgeHeader;
+class CPU;
+
+//  Event driven PPU, instead of being ticked every T-cycle it only runs at the
+// events where something changes: each line's start (LY, LY=LYC, entering OAM
+// scan or VBlank), the start of drawing (mode 3) and HBlank. The CPU runs until the next event with
+// runUntil, so LY, STAT, and the VBlank and STAT interrupts change exactly at
+// event boundaries and nothing runs in between.
+//  The event code is a template on an accuracy policy, built once for each: the
+// scanline policy renders each line whole as drawing starts, the pixel FIFO
+// policy runs the background fetcher and FIFO a dot at a time, catching up to
+// the CPU before each LCD register write so writes part way through a line
+// (SCX, palettes, the window) land on the pixel they would on hardware
+class PPU {
+  public:
+    static constexpr uint32_t screen_width = 160;
+    static constexpr uint32_t screen_height = 144;
+    enum Accuracy : uint8_t {ACCURACY_SCANLINE, ACCURACY_PIXEL_FIFO};
+  private:
+    Bus &bus;
+    CPU &cpu;
+    // T-cycles per scanline, lines per frame (VBlank is 144-153), and OAM scan length
+    static constexpr uint32_t line_cycles = 456;
+    static constexpr uint32_t lines = 154;
+    static constexpr uint32_t oam_scan_cycles = 80;
+    enum Event : uint8_t {LINE_START, DRAW, HBLANK};
+    Event event; // What happens at next_event
+    uint64_t next_event; // T-cycle of the next event (UINT64_MAX while the LCD is off)
+    uint64_t line_start; // T-cycle the current line started on
+    uint8_t ly;
+    uint8_t mode; // STAT mode (0 HBlank, 1 VBlank, 2 OAM scan, 3 drawing)
+    bool lcd_on;
+    bool stat_line; // STAT interrupt line, the interrupt is requested as it goes high
+    uint8_t window_line; // Line of the window drawn next (only counts lines it is on)
+    // Sprites on the current line (OAM indexes, 10 at most), found by OAM scan
+    uint8_t sprites[10];
+    uint8_t sprite_count;
+    TileCache tiles; // Tile data, decoded
+    const RenderKernels &kernels;
+    //  Frames, drawn a line at a time into the back buffer and published as
+    // VBlank starts
+    FrameBuffer frames;
+    uint32_t frame_count; // VBlanks entered
+    //  Accuracy policies, and the event code built for the one picked (called
+    // through these pointers, so there is no check of the accuracy per event)
+    struct ScanlinePolicy {
+      static constexpr bool pixel_fifo = false;
+    };
+    struct PixelFIFOPolicy {
+      static constexpr bool pixel_fifo = true;
+    };
+    Accuracy accuracy;
+    void (PPU::*run_event)();
+    void (PPU::*draw_until)(uint64_t cycle);
+    //  Pixel FIFO state for the line being drawn, the background FIFO only takes
+    // a fetched tile row once it is empty (as on DMG), and sprites are mixed
+    // into a line of sprite pixels as each is fetched, so the first one to
+    // claim a pixel keeps it
+    struct FIFO {
+      uint8_t x; // Pixels sent to the LCD
+      uint16_t dot; // Dots since drawing started
+      int8_t fetch_step; // Dots into the tile fetch (below 0 in the first one, thrown away)
+      uint8_t fetch_x; // Tile column fetched next
+      uint8_t bg[8]; // Background or window color numbers
+      uint8_t bg_head;
+      uint8_t bg_count;
+      uint8_t discard; // Pixels still to drop (SCX & 7 at the start of the line)
+      uint8_t stall; // Dots left of a sprite fetch
+      uint8_t next_sprite; // Index in sprites of the next one to fetch
+      bool window; // Fetching the window
+      //  Sprite pixel for each X + 8 (0 if none), color number with the palette
+      // (bit 4) and behind background (bit 7) attributes
+      uint8_t obj[screen_width + 16];
+    };
+    FIFO fifo;
+    // I/O register at addr, straight from backing memory
+    uint8_t readIO(uint16_t addr);
+    void writeIO(uint16_t addr, uint8_t val);
+    void setMode(uint8_t mode);
+    void setLY(uint8_t ly);
+    // Raise the STAT interrupt if the STAT interrupt line just went high
+    void updateStat();
+    // Run events up to the CPU's clock
+    void sync();
+    template <class Policy> void runEvent();
+    template <class Policy> void drawUntil(uint64_t cycle);
+    void startLine();
+    void lcdcWritten();
+    void scanOAM();
+    //  Tile (in TileCache numbering) of a background or window tile number, as LCDC
+    // bit 4 addresses it
+    static uint16_t tileIndex(uint8_t lcdc, uint8_t tile);
+    void renderLine();
+    // Pixel FIFO, start drawing a line, and draw up to dot (or the end of the line)
+    void startFIFO();
+    void stepFIFO(uint32_t dot);
+    void fetchSprite(uint8_t index);
+    //  ROMs that need the pixel FIFO, by header fields, which are read without
+    // touching the rest of the ROM
+    struct ROMKey {
+      const char *title; // As CartridgeHeader::getTitle gives it
+      uint8_t header_checksum;
+      uint16_t global_checksum;
+    };
+    static const std::vector<ROMKey> pixel_fifo_roms;
+  public:
+    //  Timing and drawing state (not decoded tiles or frames), as plain data so it
+    // can be copied and compared, for JIT lockstep to put it back
+    struct State {
+      Event event;
+      uint64_t next_event;
+      uint64_t line_start;
+      uint8_t ly;
+      uint8_t mode;
+      bool lcd_on;
+      bool stat_line;
+      uint8_t window_line;
+      uint8_t sprites[10];
+      uint8_t sprite_count;
+      uint32_t frame_count;
+      FIFO fifo;
+    };
+    //  Create PPU object with the given accuracy, starting at line 0 if the LCD
+    // is already on (boot skipped)
+    PPU(Bus &bus, CPU &cpu, Accuracy accuracy);
+    // Accuracy a ROM needs, by its header (scanline unless listed)
+    static Accuracy accuracyFor(CartridgeHeader &header);
+    Accuracy getAccuracy();
+    //  T-cycle of the next event, the CPU should run no further than this before
+    // runUntil is called
+    uint64_t nextEvent();
+    // Run every event up to cycle (the CPU's clock)
+    void runUntil(uint64_t cycle);
+    //  LCDC, STAT, and LYC writes (from the Bus), turning the LCD on or off and
+    // updating LY=LYC and the STAT interrupt line
+    void writeLCDC(uint8_t val);
+    void writeSTAT(uint8_t val);
+    void writeLYC(uint8_t val);
+    // Other LCD registers (SCY, SCX, BGP, OBP0, OBP1, WY, WX)
+    void writeRegister(uint16_t addr, uint8_t val);
+    //  VRAM tile data for tile (0 at 0x8000 up to 383) was written (from the Bus),
+    // or all of VRAM was changed some other way
+    void tileWritten(uint16_t tile) {
+      tiles.invalidate(tile);
+    }
+    void vramChanged();
+    //  State, and setting it back, padding is zeroed so two States can be compared
+    // with memcmp (frames already published stay published)
+    State getState();
+    void setState(const State &state);
+    //  Finished frames, for a renderer or recorder to take (from any one thread)
+    // with acquire and getFront
+    FrameBuffer& getFrames();
+    uint32_t getFrameCount();
+};
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ROMLibrary class function definitions
+*/
+
+// Include libraries
+#include <cctype>
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+// Include local header files
+#include "Cartridge.h"
+#include "CartridgeHeader.h"
+#include "ROMLibrary.h"
+
+// Create ROMLibrary object
+ROMLibrary::ROMLibrary(const char *cache_path) {
+  this->cache_path = cache_path;
+  loadCache();
+  indexEntries();
+}
+
+CartridgeHeader ROMLibrary::Entry::getHeader() const {
+  return CartridgeHeader(header, global_checksum_valid);
+}
+
+void ROMLibrary::loadCache() {
+  // Start empty if there is no cache, or it is from another version or cut short
+  FILE *file = fopen(cache_path.c_str(), "rb");
+  if (file == nullptr) {
+    return;
+  }
+  char magic[4];
+  uint32_t version = 0;
+  uint32_t count = 0;
+  bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, cache_magic, 4) == 0
+  && fread(&version, sizeof(version), 1, file) == 1 && version == cache_version
+  && fread(&count, sizeof(count), 1, file) == 1;
+  for (uint32_t i = 0; ok && i < count; i++) {
+    Entry entry;
+    uint8_t checksum_valid = 0;
+    uint16_t path_length = 0;
+    ok = fread(&entry.hash, sizeof(entry.hash), 1, file) == 1
+    && fread(&entry.size, sizeof(entry.size), 1, file) == 1
+    && fread(&entry.modified, sizeof(entry.modified), 1, file) == 1
+    && fread(entry.header, 1, sizeof(entry.header), file) == sizeof(entry.header)
+    && fread(&checksum_valid, 1, 1, file) == 1
+    && fread(&path_length, sizeof(path_length), 1, file) == 1;
+    if (ok) {
+      entry.global_checksum_valid = checksum_valid != 0;
+      entry.path.resize(path_length);
+      ok = fread(&entry.path[0], 1, path_length, file) == path_length;
+    }
+    if (ok) {
+      entries.push_back(entry);
+    }
+  }
+  fclose(file);
+  if (!ok) {
+    entries.clear();
+  }
+}
+
+bool ROMLibrary::readROM(const std::string &path, Entry &entry) {
+  //  Read the file padded as Cartridge pads it, so the hash is of the ROM as it
+  // is loaded, returns false if it can't be read or has no header
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> rom(Cartridge::paddedSize(entry.size), 0xff);
+  size_t read = fread(rom.data(), 1, entry.size, file);
+  fclose(file);
+  if (read != entry.size) {
+    return false;
+  }
+  CartridgeHeader header(rom.data(), entry.size);
+  if (!header.isValid()) {
+    return false;
+  }
+  entry.hash = Cartridge::hashROM(rom.data(), rom.size());
+  entry.path = path;
+  memcpy(entry.header, header.getBytes(), sizeof(entry.header));
+  entry.global_checksum_valid = header.checkGlobalChecksum(rom.data(), entry.size);
+  return true;
+}
+
+void ROMLibrary::indexEntries() {
+  // ROMs found more than once (same hash) are found at their first entry
+  by_hash.clear();
+  for (size_t i = 0; i < entries.size(); i++) {
+    by_hash.emplace(entries[i].hash, i);
+  }
+}
+
+uint32_t ROMLibrary::scan(const char *dir) {
+  namespace fs = std::filesystem;
+  std::error_code error;
+  fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, error);
+  if (error) {
+    printf("Error: Could not open ROM directory %s\n", dir);
+    return 0;
+  }
+  // Cached entries by path, to reuse for files that haven't changed
+  std::unordered_map<std::string, size_t> cached;
+  for (size_t i = 0; i < entries.size(); i++) {
+    cached.emplace(entries[i].path, i);
+  }
+  std::vector<Entry> scanned;
+  uint32_t read = 0;
+  for (; it != fs::recursive_directory_iterator(); it.increment(error)) {
+    if (error) {
+      break;
+    }
+    std::string extension = it->path().extension().string();
+    for (char &c : extension) {
+      c = tolower((unsigned char)c);
+    }
+    if ((extension != ".gb" && extension != ".gbc") || !it->is_regular_file(error)) {
+      continue;
+    }
+    Entry entry;
+    entry.path = it->path().generic_string();
+    entry.size = it->file_size(error);
+    entry.modified = it->last_write_time(error).time_since_epoch().count();
+    if (error) {
+      continue;
+    }
+    auto found = cached.find(entry.path);
+    if (found != cached.end() && entries[found->second].size == entry.size
+    && entries[found->second].modified == entry.modified) {
+      scanned.push_back(entries[found->second]);
+    } else if (readROM(entry.path, entry)) {
+      scanned.push_back(entry);
+      read++;
+    }
+  }
+  // Entries from other directories stay, ones from this one are replaced
+  std::string prefix = fs::path(dir).generic_string();
+  if (prefix.empty() || prefix.back() != '/') {
+    prefix.push_back('/');
+  }
+  for (const Entry &entry : entries) {
+    if (entry.path.compare(0, prefix.size(), prefix) != 0) {
+      scanned.push_back(entry);
+    }
+  }
+  entries.swap(scanned);
+  indexEntries();
+  return read;
+}
+
+bool ROMLibrary::save() {
+  //  Write a new cache next to the old one and then rename it over the top, so
+  // the cache is never left half written
+  std::string temp_path = cache_path + ".tmp";
+  FILE *file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  uint32_t count = entries.size();
+  bool ok = fwrite(cache_magic, 1, 4, file) == 4
+  && fwrite(&cache_version, sizeof(cache_version), 1, file) == 1
+  && fwrite(&count, sizeof(count), 1, file) == 1;
+  for (size_t i = 0; ok && i < entries.size(); i++) {
+    const Entry &entry = entries[i];
+    uint8_t checksum_valid = entry.global_checksum_valid;
+    uint16_t path_length = entry.path.size() < 0xffff ? entry.path.size() : 0xffff;
+    ok = fwrite(&entry.hash, sizeof(entry.hash), 1, file) == 1
+    && fwrite(&entry.size, sizeof(entry.size), 1, file) == 1
+    && fwrite(&entry.modified, sizeof(entry.modified), 1, file) == 1
+    && fwrite(entry.header, 1, sizeof(entry.header), file) == sizeof(entry.header)
+    && fwrite(&checksum_valid, 1, 1, file) == 1
+    && fwrite(&path_length, sizeof(path_length), 1, file) == 1
+    && fwrite(entry.path.data(), 1, path_length, file) == path_length;
+  }
+  ok = fclose(file) == 0 && ok;
+  std::error_code error;
+  if (ok) {
+    std::filesystem::rename(temp_path, cache_path, error);
+  }
+  if (!ok || error) {
+    std::filesystem::remove(temp_path, error);
+    return false;
+  }
+  return true;
+}
+
+const std::vector<ROMLibrary::Entry>& ROMLibrary::getEntries() {
+  return entries;
+}
+
+const ROMLibrary::Entry* ROMLibrary::find(uint64_t hash) {
+  auto found = by_hash.find(hash);
+  return found != by_hash.end() ? &entries[found->second] : nullptr;
+}
@@ -0,0 +1,57 @@
+/*
+ROMLibrary class function signatures
+*/
+
+#ifndef ROMLIBRARY_H
+#define ROMLIBRARY_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <string>
+#include <unordered_map>
+#include <vector>
+// Include local header files
+#include "CartridgeHeader.h"
+
+//  Index of the ROMs in a directory, with each one's hash and header kept in a
+// cache file. A ROM is only read (and hashed) again if its size or modification
+// time changed since it was cached, so indexing thousands of ROMs that haven't
+// changed only costs listing the directory
+class ROMLibrary {
+  public:
+    struct Entry {
+      uint64_t hash; // Cartridge::hashROM of the ROM, as loaded
+      uint64_t size; // File size in bytes
+      int64_t modified; // File modification time, only compared with itself
+      std::string path;
+      uint8_t header[CartridgeHeader::header_size];
+      bool global_checksum_valid;
+      CartridgeHeader getHeader() const;
+    };
+  private:
+    std::string cache_path;
+    std::vector<Entry> entries;
+    std::unordered_map<uint64_t, size_t> by_hash; // Index in entries of each hash
+    //  Cache file, a short header then each entry's fixed size fields followed
+    // by its path, in host byte order (a cache from another version or host is
+    // just rebuilt)
+    static constexpr char cache_magic[4] = {'G', 'G', 'B', 'L'};
+    static constexpr uint32_t cache_version = 1;
+    void loadCache();
+    bool readROM(const std::string &path, Entry &entry);
+    void indexEntries();
+  public:
+    // Create ROMLibrary object, with the entries cached at cache_path (if any)
+    ROMLibrary(const char *cache_path);
+    //  Index the ROMs (.gb and .gbc files) in dir and its subdirectories, reusing
+    // cached entries for files that haven't changed and dropping ones that are
+    // gone, returns the number of ROMs that had to be read
+    uint32_t scan(const char *dir);
+    // Write the entries to the cache file, returns false if it couldn't be written
+    bool save();
+    const std::vector<Entry>& getEntries();
+    // Entry for the ROM with this hash (nullptr if there is none)
+    const Entry* find(uint64_t hash);
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+RenderKernels class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+// Include local header files
+#include "RenderKernels.h"
+
+const RenderKernels& RenderKernels::get() {
+  static const RenderKernels kernels = select();
+  return kernels;
+}
+
+RenderKernels RenderKernels::select() {
+  // Every x86-64 CPU has SSE2, AVX2 is checked for
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {&RenderKernels::decodeTileAVX2, &RenderKernels::applyPaletteAVX2, &RenderKernels::mergeSpritesAVX2, "AVX2"};
+  }
+#endif
+  return {&RenderKernels::decodeTileSSE2, &RenderKernels::applyPaletteSSE2, &RenderKernels::mergeSpritesSSE2, "SSE2"};
+#else
+  return {&RenderKernels::decodeTileScalar, &RenderKernels::applyPaletteScalar, &RenderKernels::mergeSpritesScalar, "scalar"};
+#endif
+}
+
+// Portable kernels (also finish off what doesn't fill a whole vector)
+void RenderKernels::decodeTileScalar(const uint8_t *data, uint8_t *pixels, uint8_t *flipped) {
+  //  Each row is 2 bytes, the first has bit 0 of each pixel's color number and
+  // the second bit 1, leftmost pixel in bit 7
+  for (int row = 0; row < 8; row++) {
+    uint8_t low = data[row * 2];
+    uint8_t high = data[row * 2 + 1];
+    for (int x = 0; x < 8; x++) {
+      uint8_t color = ((low >> (7 - x)) & 1) | (((high >> (7 - x)) & 1) << 1);
+      pixels[row * 8 + x] = color;
+      flipped[row * 8 + 7 - x] = color;
+    }
+  }
+}
+
+void RenderKernels::applyPaletteScalar(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    shades[i] = (palette >> (colors[i] * 2)) & 0x03;
+  }
+}
+
+void RenderKernels::mergeSpritesScalar(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+const uint8_t *opaque, const uint8_t *behind, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (opaque[i] && (!behind[i] || colors[i] == 0)) {
+      shades[i] = sprite_shades[i];
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+//  SSE2 kernels, tile rows are decoded by copying each data byte across 8
+// bytes (unpacking it with itself three times) and testing one bit in each
+void RenderKernels::decodeTileSSE2(const uint8_t *data, uint8_t *pixels, uint8_t *flipped) {
+  // Bit for each pixel of a row's low then high byte, and what it is worth
+  const __m128i bits = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+  const __m128i bits_flipped = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m128i weights = _mm_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2);
+  __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+  __m128i halves[2] = {_mm_unpacklo_epi8(bytes, bytes), _mm_unpackhi_epi8(bytes, bytes)};
+  for (int half = 0; half < 2; half++) {
+    __m128i pairs[2] = {_mm_unpacklo_epi16(halves[half], halves[half]), _mm_unpackhi_epi16(halves[half], halves[half])};
+    for (int pair = 0; pair < 2; pair++) {
+      // A row's low byte in the first 8 bytes and high byte in the last 8
+      __m128i first = _mm_unpacklo_epi32(pairs[pair], pairs[pair]);
+      __m128i second = _mm_unpackhi_epi32(pairs[pair], pairs[pair]);
+      int offset = (half * 4 + pair * 2) * 8;
+      __m128i a = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(first, bits), bits), weights);
+      __m128i b = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(second, bits), bits), weights);
+      _mm_storeu_si128((__m128i*)(pixels + offset), _mm_or_si128(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)));
+      a = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(first, bits_flipped), bits_flipped), weights);
+      b = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(second, bits_flipped), bits_flipped), weights);
+      _mm_storeu_si128((__m128i*)(flipped + offset), _mm_or_si128(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)));
+    }
+  }
+}
+
+void RenderKernels::applyPaletteSSE2(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count) {
+  //  No byte shuffle before SSSE3, so each color number is compared for and
+  // its shade selected
+  __m128i lookup[4];
+  for (int color = 0; color < 4; color++) {
+    lookup[color] = _mm_set1_epi8((palette >> (color * 2)) & 0x03);
+  }
+  uint32_t i = 0;
+  for (; i + 16 <= count; i = i + 16) {
+    __m128i in = _mm_loadu_si128((const __m128i*)(colors + i));
+    __m128i out = _mm_setzero_si128();
+    for (int color = 0; color < 4; color++) {
+      out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(color)), lookup[color]));
+    }
+    _mm_storeu_si128((__m128i*)(shades + i), out);
+  }
+  applyPaletteScalar(colors + i, palette, shades + i, count - i);
+}
+
+void RenderKernels::mergeSpritesSSE2(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+const uint8_t *opaque, const uint8_t *behind, uint32_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t i = 0;
+  for (; i + 16 <= count; i = i + 16) {
+    __m128i bg_clear = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(colors + i)), zero);
+    __m128i hidden = _mm_andnot_si128(bg_clear, _mm_loadu_si128((const __m128i*)(behind + i)));
+    __m128i mask = _mm_andnot_si128(hidden, _mm_loadu_si128((const __m128i*)(opaque + i)));
+    __m128i bg = _mm_loadu_si128((const __m128i*)(shades + i));
+    __m128i sprite = _mm_loadu_si128((const __m128i*)(sprite_shades + i));
+    _mm_storeu_si128((__m128i*)(shades + i), _mm_or_si128(_mm_and_si128(mask, sprite), _mm_andnot_si128(mask, bg)));
+  }
+  mergeSpritesScalar(shades + i, colors + i, sprite_shades + i, opaque + i, behind + i, count - i);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+//  AVX2 kernels, compiled for AVX2 only here so the rest of the build doesn't
+// need it, tile rows are copied across bytes with one shuffle per 2 rows
+__attribute__((target("avx2")))
+void RenderKernels::decodeTileAVX2(const uint8_t *data, uint8_t *pixels, uint8_t *flipped) {
+  //  Each shuffle puts a row's low byte 8 times then its high byte 8 times in
+  // each 128 bit lane, rows 0 and 2 (then 1 and 3) so that pairing them up
+  // leaves rows 0-3 in order
+  const __m256i spread[4] = {
+    _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5),
+    _mm256_setr_epi8(2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7),
+    _mm256_setr_epi8(8, 8, 8, 8, 8, 8, 8, 8, 9, 9, 9, 9, 9, 9, 9, 9, 12, 12, 12, 12, 12, 12, 12, 12, 13, 13, 13, 13, 13, 13, 13, 13),
+    _mm256_setr_epi8(10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 14, 14, 14, 14, 14, 14, 14, 14, 15, 15, 15, 15, 15, 15, 15, 15)
+  };
+  const __m256i bits = _mm256_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1,
+  -128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+  const __m256i bits_flipped = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+  1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  const __m256i weights = _mm256_setr_epi8(1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,
+  1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2);
+  __m256i bytes = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)data));
+  for (int half = 0; half < 2; half++) {
+    __m256i first = _mm256_shuffle_epi8(bytes, spread[half * 2]);
+    __m256i second = _mm256_shuffle_epi8(bytes, spread[half * 2 + 1]);
+    __m256i a = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(first, bits), bits), weights);
+    __m256i b = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(second, bits), bits), weights);
+    _mm256_storeu_si256((__m256i*)(pixels + half * 32), _mm256_or_si256(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b)));
+    a = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(first, bits_flipped), bits_flipped), weights);
+    b = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(second, bits_flipped), bits_flipped), weights);
+    _mm256_storeu_si256((__m256i*)(flipped + half * 32), _mm256_or_si256(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b)));
+  }
+}
+
+__attribute__((target("avx2")))
+void RenderKernels::applyPaletteAVX2(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count) {
+  // The 4 shades in the first 4 bytes of each lane, color numbers shuffle them out
+  uint32_t table = 0;
+  for (int color = 0; color < 4; color++) {
+    table = table | (uint32_t)((palette >> (color * 2)) & 0x03) << (color * 8);
+  }
+  const __m256i lookup = _mm256_set1_epi32(table);
+  uint32_t i = 0;
+  for (; i + 32 <= count; i = i + 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i*)(colors + i));
+    _mm256_storeu_si256((__m256i*)(shades + i), _mm256_shuffle_epi8(lookup, in));
+  }
+  applyPaletteScalar(colors + i, palette, shades + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void RenderKernels::mergeSpritesAVX2(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+const uint8_t *opaque, const uint8_t *behind, uint32_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  uint32_t i = 0;
+  for (; i + 32 <= count; i = i + 32) {
+    __m256i bg_clear = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(colors + i)), zero);
+    __m256i hidden = _mm256_andnot_si256(bg_clear, _mm256_loadu_si256((const __m256i*)(behind + i)));
+    __m256i mask = _mm256_andnot_si256(hidden, _mm256_loadu_si256((const __m256i*)(opaque + i)));
+    __m256i bg = _mm256_loadu_si256((const __m256i*)(shades + i));
+    __m256i sprite = _mm256_loadu_si256((const __m256i*)(sprite_shades + i));
+    _mm256_storeu_si256((__m256i*)(shades + i), _mm256_blendv_epi8(bg, sprite, mask));
+  }
+  mergeSpritesScalar(shades + i, colors + i, sprite_shades + i, opaque + i, behind + i, count - i);
+}
+#endif
+#endif
@@ -0,0 +1,51 @@
+/*
+RenderKernels class function signatures
+*/
+
+#ifndef RENDERKERNELS_H
+#define RENDERKERNELS_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+
+//  The inner loops of rendering, each with a portable version and SSE2 and
+// AVX2 versions on x86-64 (AVX2 needs GCC or Clang). The fastest one this CPU
+// runs is picked once at startup, so one build runs everywhere
+class RenderKernels {
+  public:
+    //  Decode a tile's 16 bytes of 2bpp data into 64 color numbers (8 rows of 8,
+    // leftmost first), and into flipped with each row flipped in X
+    typedef void (*DecodeTile)(const uint8_t *data, uint8_t *pixels, uint8_t *flipped);
+    // Map count color numbers (0-3) to shades through a palette register (BGP, OBP0, OBP1)
+    typedef void (*ApplyPalette)(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count);
+    //  Put sprite_shades over shades wherever opaque is 0xff, unless behind is
+    // 0xff there too and the background's color number isn't 0
+    typedef void (*MergeSprites)(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+    const uint8_t *opaque, const uint8_t *behind, uint32_t count);
+    DecodeTile decodeTile;
+    ApplyPalette applyPalette;
+    MergeSprites mergeSprites;
+    const char *name; // "AVX2", "SSE2", or "scalar"
+    // Kernels for this CPU
+    static const RenderKernels& get();
+  private:
+    static RenderKernels select();
+    static void decodeTileScalar(const uint8_t *data, uint8_t *pixels, uint8_t *flipped);
+    static void applyPaletteScalar(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count);
+    static void mergeSpritesScalar(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+    const uint8_t *opaque, const uint8_t *behind, uint32_t count);
+#if defined(__x86_64__) || defined(_M_X64)
+    static void decodeTileSSE2(const uint8_t *data, uint8_t *pixels, uint8_t *flipped);
+    static void applyPaletteSSE2(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count);
+    static void mergeSpritesSSE2(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+    const uint8_t *opaque, const uint8_t *behind, uint32_t count);
+#if defined(__GNUC__) || defined(__clang__)
+    static void decodeTileAVX2(const uint8_t *data, uint8_t *pixels, uint8_t *flipped);
+    static void applyPaletteAVX2(const uint8_t *colors, uint8_t palette, uint8_t *shades, uint32_t count);
+    static void mergeSpritesAVX2(uint8_t *shades, const uint8_t *colors, const uint8_t *sprite_shades,
+    const uint8_t *opaque, const uint8_t *behind, uint32_t count);
+#endif
+#endif
+};
+
+#endif
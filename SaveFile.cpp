@@ -0,0 +1,148 @@
+/*
+SaveFile class function definitions
+*/
+
+// Include libraries
+#include <algorithm>
+#include <chrono>
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+// Include local header files
+#include "SaveFile.h"
+
+// Create SaveFile object
+SaveFile::SaveFile(const char *path, uint32_t size) {
+  this->size = size;
+#if defined(_WIN32)
+  // Mapping a file grows it to the mapping's size (new bytes are 0)
+  file_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    printf("Error: Could not open save file %s\n", path);
+    exit(1);
+  }
+  map_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READWRITE, 0, size, nullptr);
+  data = map_handle != nullptr ? (uint8_t*)MapViewOfFile(map_handle, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+#else
+  int file = open(path, O_RDWR | O_CREAT, 0644);
+  struct stat file_stat;
+  if (file < 0 || fstat(file, &file_stat) != 0) {
+    printf("Error: Could not open save file %s\n", path);
+    exit(1);
+  }
+  // Grow new or short files to size (new bytes are 0), longer ones are left as is
+  if ((uint64_t)file_stat.st_size < size && ftruncate(file, size) != 0) {
+    printf("Error: Could not grow save file %s\n", path);
+    exit(1);
+  }
+  data = (uint8_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  if (data == MAP_FAILED) {
+    data = nullptr;
+  }
+  close(file); // The mapping keeps the file open
+#endif
+  if (data == nullptr) {
+    printf("Error: Could not map save file %s\n", path);
+    exit(1);
+  }
+  pending.assign((size + 0xff) / 0x100, 0);
+  has_pending = false;
+  stopping = false;
+  flusher = std::thread(&SaveFile::flushLoop, this);
+}
+
+const uint8_t* SaveFile::getData() {
+  return data;
+}
+
+void SaveFile::update(const uint8_t *ram, const std::vector<uint8_t> &dirty) {
+  //  Copy on the emulator's thread so RAM is never read while it is being
+  // written, the flush thread only ever reads the mapping
+  for (uint32_t page = 0; page < pending.size(); page++) {
+    if (dirty[page]) {
+      uint32_t start = page * 0x100;
+      memcpy(data + start, ram + start, std::min<uint32_t>(0x100, size - start));
+    }
+  }
+  std::lock_guard<std::mutex> lock(pending_lock);
+  for (uint32_t page = 0; page < pending.size(); page++) {
+    pending[page] = pending[page] | dirty[page];
+  }
+  has_pending = true;
+  pending_ready.notify_one();
+}
+
+void SaveFile::flushLoop() {
+  //  Wait for pages to write out, then wait flush_delay_ms more so a game
+  // writing its save over several frames goes out in one flush
+  std::unique_lock<std::mutex> lock(pending_lock);
+  while (true) {
+    pending_ready.wait(lock, [this] { return has_pending || stopping; });
+    if (!has_pending) {
+      return; // Stopping with nothing left to write
+    }
+    pending_ready.wait_for(lock, std::chrono::milliseconds(flush_delay_ms), [this] { return stopping; });
+    std::vector<uint8_t> pages = pending;
+    std::fill(pending.begin(), pending.end(), 0);
+    has_pending = false;
+    lock.unlock();
+    flushPages(pages);
+    lock.lock();
+  }
+}
+
+void SaveFile::flushPages(const std::vector<uint8_t> &pages) {
+  //  Write each run of pages out to the file, msync needs the start rounded
+  // down to a whole OS page
+#if !defined(_WIN32)
+  uint32_t os_page = sysconf(_SC_PAGESIZE);
+#endif
+  uint32_t page = 0;
+  while (page < pages.size()) {
+    if (!pages[page]) {
+      page++;
+      continue;
+    }
+    uint32_t first = page;
+    while (page < pages.size() && pages[page]) {
+      page++;
+    }
+    uint32_t start = first * 0x100;
+    uint32_t end = std::min<uint32_t>(page * 0x100, size);
+#if defined(_WIN32)
+    FlushViewOfFile(data + start, end - start);
+#else
+    start = start - start % os_page;
+    msync(data + start, end - start, MS_SYNC);
+#endif
+  }
+#if defined(_WIN32)
+  FlushFileBuffers(file_handle);
+#endif
+}
+
+// Delete all SaveFile related objects
+SaveFile::~SaveFile() {
+  {
+    std::lock_guard<std::mutex> lock(pending_lock);
+    stopping = true;
+    pending_ready.notify_one();
+  }
+  flusher.join(); // Writes out whatever is still pending first
+#if defined(_WIN32)
+  UnmapViewOfFile(data);
+  CloseHandle(map_handle);
+  CloseHandle(file_handle);
+#else
+  munmap(data, size);
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+SaveFile class function signatures
+*/
+
+#ifndef SAVEFILE_H
+#define SAVEFILE_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//  Battery save (.sav) file, mapped read/write and shared with the file so
+// saving is a copy into the mapping. Only 256 byte pages written since the last
+// update are copied, and a background thread writes them out to disk a little
+// later (batching pages written close together), the rest of the file is never
+// touched. Anything still pending is written out when the SaveFile is deleted
+class SaveFile {
+  private:
+    uint8_t* data; // File mapping
+    uint32_t size;
+#if defined(_WIN32)
+    void* file_handle;
+    void* map_handle;
+#endif
+    // Flush thread, and the pages (1 per 256 bytes) it hasn't written out yet
+    std::thread flusher;
+    std::mutex pending_lock;
+    std::condition_variable pending_ready;
+    std::vector<uint8_t> pending;
+    bool has_pending;
+    bool stopping;
+    static constexpr uint32_t flush_delay_ms = 1000;
+    void flushLoop();
+    void flushPages(const std::vector<uint8_t> &pages);
+  public:
+    // Create SaveFile object for the file at path (created or grown to size bytes)
+    SaveFile(const char *path, uint32_t size);
+    // Contents of the file (size bytes), for loading RAM from it
+    const uint8_t* getData();
+    //  Copy the pages set in dirty (1 per 256 bytes) from ram into the file, the
+    // flush thread writes them out
+    void update(const uint8_t *ram, const std::vector<uint8_t> &dirty);
+    // Delete all SaveFile related objects (writing out any pending pages first)
+    ~SaveFile();
+};
+
+#endif
@@ -0,0 +1,26 @@
+/*
+TileCache class function definitions
+*/
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+#include <cstring>
+// Include local header files
+#include "Bus.h"
+#include "TileCache.h"
+
+// Create TileCache object
+TileCache::TileCache(Bus &bus) : bus(bus), kernels(RenderKernels::get()) {
+  memset(pixels, 0, sizeof(pixels));
+  invalidateAll();
+}
+
+void TileCache::invalidateAll() {
+  memset(stale, 0xff, sizeof(stale));
+}
+
+void TileCache::decode(uint16_t tile) {
+  const uint8_t *data = bus.getMemory() + Bus::memoryOffset(0x8000) + tile * 16;
+  kernels.decodeTile(data, pixels[tile][0], pixels[tile][1]);
+  stale[tile >> 6] = stale[tile >> 6] & ~((uint64_t)1 << (tile & 63));
+}
@@ -0,0 +1,46 @@
+/*
+TileCache class function signatures
+*/
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+// Include libraries
+#include <cinttypes> // To use uint*_t
+// Include local header files
+#include "RenderKernels.h"
+
+class Bus;
+
+//  Every tile in VRAM tile data (0x8000-0x97ff, 384 tiles) decoded from 2bpp
+// into one color number (0-3) per byte, as is and flipped in X, so rendering a
+// line is copying rows out of here. A write to a tile's data marks it stale and
+// it is decoded again the next time it is drawn, most frames change few tiles
+class TileCache {
+  public:
+    static constexpr uint32_t tile_count = 384;
+  private:
+    Bus &bus;
+    const RenderKernels &kernels;
+    uint8_t pixels[tile_count][2][64]; // Tile, X flipped, then 8 rows of 8 pixels
+    uint64_t stale[tile_count / 64]; // 1 bit per tile (bit n % 64 of word n / 64)
+    void decode(uint16_t tile);
+  public:
+    // Create TileCache object, with every tile stale
+    TileCache(Bus &bus);
+    //  Tile data for tile (0 at 0x8000 up to 383 at 0x97f0) was written, or all of
+    // VRAM was (e.g. loading a snapshot)
+    void invalidate(uint16_t tile) {
+      stale[tile >> 6] = stale[tile >> 6] | ((uint64_t)1 << (tile & 63));
+    }
+    void invalidateAll();
+    // 8 color numbers for row (0-7) of tile, left to right (right to left if flip)
+    const uint8_t* row(uint16_t tile, uint8_t row, bool flip) {
+      if ((stale[tile >> 6] >> (tile & 63)) & 1) {
+        decode(tile);
+      }
+      return pixels[tile][flip] + row * 8;
+    }
+};
+
+#endif
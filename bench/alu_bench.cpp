@@ -0,0 +1,196 @@
+/*
+ALU flag benchmark driver
+*/
+
+//  Checks the CPU's adc/sbc/inc/dec flags against the switch based helpers they
+// replaced for every operand, then times both and prints ns per flag result,
+// e.g. from the repository root:
+//   g++ -std=c++17 -O2 -I. -o alu_bench bench/alu_bench.cpp CPU.cpp JIT.cpp Bus.cpp MBC.cpp CartridgeHeader.cpp PPU.cpp TileCache.cpp RenderKernels.cpp FrameBuffer.cpp -lpthread
+//   alu_bench [calls] [runs]
+// Both sides are called through function pointers, so neither gets inlined
+// into the loop and the difference is the flag work itself
+
+// Include libraries
+#include <chrono>
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+// Include local header files
+#include "CPU.h"
+
+typedef uint8_t (*CarryFlagFunction)(uint8_t x, uint8_t y, uint8_t c);
+typedef uint8_t (*IncFlagFunction)(uint8_t x);
+
+//  Flags as the helpers worked them out before the flag tables, F starts at 0
+// (inc and dec leave the carry flag to the caller)
+static uint8_t switchAdcFlags(uint8_t x, uint8_t y, uint8_t c) {
+  uint8_t F = 0;
+  // Set half carry flag if overflow from bit 3, carry flag if overflow from bit 7
+  switch (((x & 0x0f) + (y & 0x0f) + c) & 0x10) {
+    case 0x10:
+      F |= 1 << 5;
+      break;
+    default:
+      F &= ~(1 << 5);
+  }
+  if (x + y + c > 0xff) {
+    F |= 1 << 4;
+  } else {
+    F &= ~(1 << 4);
+  }
+  // Set zero flag to 1 if result is 0, clear subtraction flag
+  switch ((uint8_t)(x + y + c)) {
+    case 0:
+      F |= 1 << 7;
+      break;
+    default:
+      F &= ~(1 << 7);
+  }
+  F &= ~(1 << 6);
+  return F;
+}
+
+static uint8_t switchSbcFlags(uint8_t x, uint8_t y, uint8_t c) {
+  uint8_t F = 0;
+  // Set half carry flag if borrow from bit 4
+  switch (((x & 0x0f) - (y & 0x0f) - c) & 0x10) {
+    case 0x10:
+      F |= 1 << 5;
+      break;
+    default:
+      F &= ~(1 << 5);
+  }
+  // Set carry flag to 1 if y (and carry) > x
+  if (y + c > x) {
+    F |= 1 << 4;
+  } else {
+    F &= ~(1 << 4);
+  }
+  // If result is zero, set zero flag to 1, if not, 0
+  switch ((uint8_t)(x - y - c)) {
+    case 0:
+      F |= 1 << 7;
+      break;
+    default:
+      F &= ~(1 << 7);
+  }
+  // Set subtraction flag to 1
+  F |= 1 << 6;
+  return F;
+}
+
+static uint8_t switchIncFlags(uint8_t x) {
+  uint8_t F = 0;
+  // Set subtraction flag to 0 and half carry flag to 1 if overflow from bit 3
+  F &= ~(1 << 6);
+  switch (((x & 0x0f) + 1) & 0x10) {
+    case 0x10:
+      F |= 1 << 5;
+      break;
+    default:
+      F &= ~(1 << 5);
+  }
+  // Set zero flag to 1 if result is 0
+  switch ((uint8_t)(x + 1)) {
+    case 0:
+      F |= 1 << 7;
+      break;
+    default:
+      F &= ~(1 << 7);
+  }
+  return F;
+}
+
+static uint8_t switchDecFlags(uint8_t x) {
+  uint8_t F = 0;
+  // Set subtraction flag to 1 and half carry flag to 1 if borrow from bit 4
+  F |= 1 << 6;
+  switch (((x & 0x0f) - 1) & 0x10) {
+    case 0x10:
+      F |= 1 << 5;
+      break;
+    default:
+      F &= ~(1 << 5);
+  }
+  // Set zero flag to 1 if result is 0
+  switch ((uint8_t)(x - 1)) {
+    case 0:
+      F |= 1 << 7;
+      break;
+    default:
+      F &= ~(1 << 7);
+  }
+  return F;
+}
+
+// Operands the timed loops cycle through (random, so branches can't be predicted)
+static const int operand_count = 4096;
+static uint8_t xs[operand_count];
+static uint8_t ys[operand_count];
+static uint8_t cs[operand_count];
+
+static double timeCarry(CarryFlagFunction flags, uint32_t calls, uint32_t &sum) {
+  // ns per call
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < calls; i++) {
+    int j = i & (operand_count - 1);
+    sum = sum + flags(xs[j], ys[j], cs[j]);
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / calls;
+}
+
+static double timeInc(IncFlagFunction flags, uint32_t calls, uint32_t &sum) {
+  // ns per call
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < calls; i++) {
+    sum = sum + flags(xs[i & (operand_count - 1)]);
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e9 / calls;
+}
+
+// Main function
+int main(int argc, char* argv[]) {
+  uint32_t calls = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000000;
+  int runs = argc > 2 ? atoi(argv[2]) : 3;
+  // Every operand and carry in must give the same flags as before
+  int mismatches = 0;
+  for (int c = 0; c < 2; c++) {
+    for (int x = 0; x < 256; x++) {
+      for (int y = 0; y < 256; y++) {
+        mismatches = mismatches + (CPU::adcFlags(x, y, c) != switchAdcFlags(x, y, c));
+        mismatches = mismatches + (CPU::sbcFlags(x, y, c) != switchSbcFlags(x, y, c));
+      }
+    }
+  }
+  for (int x = 0; x < 256; x++) {
+    mismatches = mismatches + (CPU::incFlags(x) != switchIncFlags(x));
+    mismatches = mismatches + (CPU::decFlags(x) != switchDecFlags(x));
+  }
+  if (mismatches != 0) {
+    printf("Error: %d flag results differ from the switch helpers\n", mismatches);
+    return 1;
+  }
+  srand(1);
+  for (int i = 0; i < operand_count; i++) {
+    xs[i] = rand() & 0xff;
+    ys[i] = rand() & 0xff;
+    cs[i] = rand() & 1;
+  }
+  // Picked at run time, so the calls stay indirect
+  volatile CarryFlagFunction carry_flags[2][2] = {
+    {&switchAdcFlags, &switchSbcFlags}, {&CPU::adcFlags, &CPU::sbcFlags}
+  };
+  volatile IncFlagFunction inc_flags[2][2] = {
+    {&switchIncFlags, &switchDecFlags}, {&CPU::incFlags, &CPU::decFlags}
+  };
+  uint32_t sum = 0;
+  for (int run = 0; run < runs; run++) {
+    for (int side = 0; side < 2; side++) {
+      printf("%-6s adc %.2fns sbc %.2fns inc %.2fns dec %.2fns\n", side == 0 ? "switch" : "CPU",
+      timeCarry(carry_flags[side][0], calls, sum), timeCarry(carry_flags[side][1], calls, sum),
+      timeInc(inc_flags[side][0], calls, sum), timeInc(inc_flags[side][1], calls, sum));
+    }
+  }
+  printf("(checksum %u)\n", sum);
+  return 0;
+}
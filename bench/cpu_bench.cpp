@@ -0,0 +1,109 @@
+/*
+CPU benchmark driver
+*/
+
+//  Runs a fixed program headless (no PPU, no window) for a fixed number of
+// instructions and prints instructions per second. The dispatch mode measured is
+// the one the CPU is built with, e.g. from the repository root:
+//   g++ -std=c++17 -O2 -I. -o cpu_bench bench/cpu_bench.cpp CPU.cpp JIT.cpp Bus.cpp MBC.cpp CartridgeHeader.cpp PPU.cpp TileCache.cpp RenderKernels.cpp FrameBuffer.cpp -lpthread
+// then again with -DGREGGB_SWITCH_DISPATCH (the opcode switch the tables
+// replaced), -DGREGGB_THREADED_DISPATCH, -DGREGGB_BLOCK_CACHE,
+// -DGREGGB_SUPERINSTRUCTIONS, or -DGREGGB_JIT (run with --jit) to compare, or
+// -DGREGGB_TRACE_SEQUENCES to print the most run instruction sequences
+//   cpu_bench [--jit] [instructions] [runs]
+
+// Include libraries
+#include <chrono>
+#include <cinttypes> // To use uint*_t
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+// Include local header files
+#include "Bus.h"
+#include "CPU.h"
+
+//  Program run by the benchmark, loaded at 0x0150 of a 32KB ROM only cartridge,
+// a loop of the instructions games spend their time in: a 64 byte memory copy,
+// a 64 byte fill, a countdown, and a call that pushes, pops, and does some ALU
+// work. Every pass writes memory, so idle loop skipping never kicks in
+static const uint8_t program[] = {
+  0x31, 0xfe, 0xff, // 0150 ld sp,0xfffe
+  0x21, 0x00, 0xc0, // 0153 ld hl,0xc000 (loop)
+  0x11, 0x00, 0xd0, // 0156 ld de,0xd000
+  0x06, 0x40, // 0159 ld b,0x40
+  0x2a, // 015b ld a,(hl+) (copy)
+  0x12, // 015c ld (de),a
+  0x13, // 015d inc de
+  0x05, // 015e dec b
+  0x20, 0xfa, // 015f jr nz,copy
+  0x21, 0x00, 0xc1, // 0161 ld hl,0xc100
+  0x06, 0x40, // 0164 ld b,0x40
+  0x22, // 0166 ld (hl+),a (fill)
+  0x05, // 0167 dec b
+  0x20, 0xfc, // 0168 jr nz,fill
+  0x0e, 0x20, // 016a ld c,0x20
+  0x0d, // 016c dec c (count)
+  0x20, 0xfd, // 016d jr nz,count
+  0xcd, 0x80, 0x01, // 016f call sub
+  0x18, 0xdf, // 0172 jr loop
+};
+static const uint8_t subroutine[] = {
+  0xc5, // 0180 push bc (sub)
+  0xd5, // 0181 push de
+  0x78, // 0182 ld a,b
+  0x89, // 0183 adc a,c
+  0xfe, 0x10, // 0184 cp 0x10
+  0xcb, 0x11, // 0186 rl c
+  0xcb, 0x7c, // 0188 bit 7,h
+  0x27, // 018a daa
+  0xd1, // 018b pop de
+  0xc1, // 018c pop bc
+  0xc9, // 018d ret
+};
+
+// Main function
+int main(int argc, char* argv[]) {
+  bool jit = false;
+  uint32_t instructions = 200000000;
+  int runs = 3;
+  int number_count = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--jit") == 0) {
+      jit = true;
+    } else if (number_count == 0) {
+      instructions = strtoul(argv[i], nullptr, 10);
+      number_count++;
+    } else {
+      runs = atoi(argv[i]);
+    }
+  }
+  //  ROM only cartridge (type 0x00 at 0x0147), 0x0100 jumps over the header to
+  // the program
+  static uint8_t rom[0x8000];
+  memset(rom, 0, sizeof(rom));
+  rom[0x0100] = 0x00; // nop
+  rom[0x0101] = 0x18; // jr 0x0150
+  rom[0x0102] = 0x4d;
+  memcpy(rom + 0x0150, program, sizeof(program));
+  memcpy(rom + 0x0180, subroutine, sizeof(subroutine));
+  for (int run = 0; run < runs; run++) {
+    Bus bus;
+    bus.mapROM(rom, sizeof(rom));
+    bus.skipBoot();
+    CPU cpu;
+    cpu.skipBoot(&bus);
+    if (jit) {
+      cpu.setJit(true, false);
+    }
+    auto start = std::chrono::steady_clock::now();
+    cpu.cpuLoop(&bus, instructions);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%u instructions in %.3fs, %.1f M instructions/s\n", instructions, seconds, instructions / seconds / 1e6);
+#ifdef GREGGB_TRACE_SEQUENCES
+    if (run == runs - 1) {
+      cpu.printSequences(20);
+    }
+#endif
+  }
+  return 0;
+}
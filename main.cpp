@@ -2,13 +2,77 @@
 Driver file
 */
 
+// Include libraries
+#include <cstring>
+#include <cstdio>
 // Include local header files
 #include "GB.h"
+#include "ROMLibrary.h"
+
+// Index the ROMs in dir (cached in cache_path) and list them
+static int indexROMs(const char *dir, const char *cache_path) {
+  ROMLibrary library(cache_path);
+  uint32_t read = library.scan(dir);
+  for (const ROMLibrary::Entry &entry : library.getEntries()) {
+    CartridgeHeader header = entry.getHeader();
+    //  Header and global checksums are shown with the title, they are what
+    // PPU::pixel_fifo_roms lists ROMs by
+    printf("%016llx %-16s %02x %04x %-11s ROM %4uKB RAM %3uKB%s%s%s %s\n", (unsigned long long)entry.hash,
+    header.getTitle().c_str(), header.getHeaderChecksum(), header.getGlobalChecksum(), header.getMBCName(), header.getROMSize() / 1024, header.getRAMSize() / 1024,
+    header.isCGBOnly() ? " CGB" : "", header.headerChecksumValid() ? "" : " bad-header",
+    header.globalChecksumValid() ? "" : " bad-global", entry.path.c_str());
+  }
+  printf("%zu ROMs, %u read\n", library.getEntries().size(), read);
+  if (!library.save()) {
+    printf("Error: Could not write %s\n", cache_path);
+    return 1;
+  }
+  return 0;
+}
 
 // Main function
-int main() {
+int main(int argc, char* argv[]) {
+  //  --jit runs hot code compiled, --jit-lockstep also checks it against the
+  // interpreter, --skip-boot starts the cartridge without a Boot ROM,
+  // --ppu-fifo and --ppu-scanline pick the PPU's accuracy over the one picked
+  // for the ROM, the other arguments are the Boot ROM (unless skipped) and
+  // cartridge ROM paths. --index lists the ROMs in a directory, caching what it
+  // finds
+  if (argc == 4 && strcmp(argv[1], "--index") == 0) {
+    return indexROMs(argv[2], argv[3]);
+  }
+  bool jit = false;
+  bool jit_lockstep = false;
+  bool skip_boot = false;
+  int ppu_accuracy = -1; // Picked for the ROM
+  const char *paths[2] = {nullptr, nullptr};
+  int path_count = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--jit") == 0) {
+      jit = true;
+    } else if (strcmp(argv[i], "--jit-lockstep") == 0) {
+      jit = jit_lockstep = true;
+    } else if (strcmp(argv[i], "--skip-boot") == 0) {
+      skip_boot = true;
+    } else if (strcmp(argv[i], "--ppu-fifo") == 0) {
+      ppu_accuracy = PPU::ACCURACY_PIXEL_FIFO;
+    } else if (strcmp(argv[i], "--ppu-scanline") == 0) {
+      ppu_accuracy = PPU::ACCURACY_SCANLINE;
+    } else if (path_count < 2) {
+      paths[path_count++] = argv[i];
+    }
+  }
+  if (path_count != (skip_boot ? 1 : 2)) {
+    printf("Usage: %s [--jit | --jit-lockstep] [--ppu-fifo | --ppu-scanline] <boot rom> <rom>\n", argv[0]);
+    printf("       %s [--jit | --jit-lockstep] [--ppu-fifo | --ppu-scanline] --skip-boot <rom>\n", argv[0]);
+    printf("       %s --index <rom directory> <cache file>\n", argv[0]);
+    return 1;
+  }
   // Create object of class GB
-  GB gameBoy;
+  GB gameBoy(skip_boot ? nullptr : paths[0], skip_boot ? paths[0] : paths[1], ppu_accuracy);
+  if (jit) {
+    gameBoy.setJit(true, jit_lockstep);
+  }
   gameBoy.emuLoop();
   return 0;
 }
\ No newline at end of file